@@ -0,0 +1,59 @@
+#pragma once
+
+#include "microloop/net/tcp_server.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <string>
+
+namespace bench
+{
+
+/**
+ * \brief Run \p func \p iterations times.
+ * \returns The average time of a run, in nanoseconds.
+ */
+template <class Func>
+double ns_per_op(std::size_t iterations, Func &&func)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < iterations; i++)
+  {
+    func(i);
+  }
+
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / iterations;
+}
+
+/* Keep the compiler from optimizing away the computation of \p value. */
+template <class T>
+void keep(const T &value)
+{
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+/* Print a result line, aligned with the others. */
+inline void report(const std::string &name, double value, const char *unit)
+{
+  std::printf("%-48s %12.1f %s\n", name.c_str(), value, unit);
+}
+
+/**
+ * \brief Peer connections standing for \p count subscribers, with made-up file descriptors. They
+ * are only used as keys, and never written to.
+ */
+inline std::deque<microloop::net::TcpServer::PeerConnection> make_peers(std::size_t count)
+{
+  std::deque<microloop::net::TcpServer::PeerConnection> peers;
+  for (std::size_t i = 0; i < count; i++)
+  {
+    peers.emplace_back(static_cast<std::uint32_t>(i + 1000));
+  }
+
+  return peers;
+}
+
+}  // namespace bench
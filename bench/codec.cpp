@@ -0,0 +1,152 @@
+/*
+ * Encoding and decoding of the messages exchanged with subscribers and devices, through the
+ * encoders and decoders generated from their schemas.
+ *
+ * Subscribe requests are also run through the hand-written code the schemas replaced, which cast
+ * the buffer to a packed structure and did not check its size.
+ */
+
+#include "bench/bench.h"
+#include "commons/device_messages.h"
+#include "commons/subscriber_messages.h"
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace
+{
+
+constexpr std::size_t ITERATIONS = 2000000;
+
+constexpr const char *TOPIC = "plant3/line12/oven4/temperature";
+
+namespace hand_written
+{
+
+struct MsgHdr
+{
+  std::uint8_t type;
+  std::uint16_t msg_size;
+} __attribute__((packed));
+
+struct POD_SubscribeRequest
+{
+  char topic[commons::device_messages::TOPIC_MAXLEN];
+  std::uint8_t flags;
+} __attribute__((packed));
+
+microloop::Buffer serialize(const commons::subscriber_messages::SubscribeRequest &req)
+{
+  microloop::Buffer buf{sizeof(MsgHdr) + sizeof(POD_SubscribeRequest)};
+  auto data = static_cast<std::uint8_t *>(buf.data());
+
+  auto hdr = (MsgHdr *)data;
+  auto payload = (POD_SubscribeRequest *)(data + sizeof(MsgHdr));
+
+  hdr->type = commons::subscriber_messages::MessageType::SUBSCRIBE;
+  hdr->msg_size = htons(sizeof(POD_SubscribeRequest));
+
+  std::string topic{req.topic};
+  std::memset(payload->topic, 0, sizeof(payload->topic));
+  std::memcpy(payload->topic, topic.c_str(), std::min(sizeof(payload->topic), topic.size()));
+  payload->flags = req.store_forward;
+
+  return buf;
+}
+
+commons::subscriber_messages::SubscribeRequest parse(const void *data)
+{
+  auto pod = (const POD_SubscribeRequest *)(static_cast<const std::uint8_t *>(data) +
+      sizeof(MsgHdr));
+
+  char topic[sizeof(pod->topic) + 1]{};
+  std::memcpy(topic, pod->topic, sizeof(pod->topic));
+
+  return {std::string{topic}, (pod->flags & 1) != 0};
+}
+
+}  // namespace hand_written
+
+/* Time the encoding of \p msg to a new buffer, and to a buffer of the caller. */
+template <class Message>
+void run_encode(const std::string &name, const Message &msg)
+{
+  auto serialize_ns =
+      bench::ns_per_op(ITERATIONS, [&](std::size_t) { bench::keep(msg.serialize()); });
+
+  std::uint8_t dest[256];
+  auto serialize_into_ns = bench::ns_per_op(
+      ITERATIONS, [&](std::size_t) { bench::keep(msg.serialize_into(dest, sizeof(dest))); });
+
+  bench::report(name + ", serialize", serialize_ns, "ns/message");
+  bench::report(name + ", serialize_into", serialize_into_ns, "ns/message");
+}
+
+/* Time the decoding of the serialized message \p buf. */
+void run_decode(const std::string &name, const microloop::Buffer &buf)
+{
+  using commons::subscriber_messages::from_buffer;
+
+  auto ns = bench::ns_per_op(
+      ITERATIONS, [&](std::size_t) { bench::keep(from_buffer(buf.data(), buf.size())); });
+  bench::report(name + ", from_buffer", ns, "ns/message");
+}
+
+/* Time the parsing of the serialized device message \p buf. */
+void run_parse(const std::string &name, const microloop::Buffer &buf)
+{
+  using commons::device_messages::DeviceMessageView;
+
+  auto ns = bench::ns_per_op(ITERATIONS,
+      [&](std::size_t) { bench::keep(DeviceMessageView::parse(buf.data(), buf.size())); });
+  bench::report(name + ", parse", ns, "ns/message");
+}
+
+}  // namespace
+
+int main()
+{
+  using namespace commons::subscriber_messages;
+  using commons::server_response::StatusCode;
+  namespace dm = commons::device_messages;
+
+  GreetingMessage greeting{"client0001", PROTOCOL_V3};
+  SubscribeRequest subscribe{TOPIC, true};
+  UnsubscribeRequest unsubscribe{TOPIC};
+  ServerResponse response{StatusCode::SUBSCRIBE_SUCCESSFUL, TOPIC};
+
+  run_encode("greeting", greeting);
+  run_decode("greeting", greeting.serialize());
+  run_encode("subscribe", subscribe);
+  run_decode("subscribe", subscribe.serialize());
+  run_encode("unsubscribe", unsubscribe);
+  run_decode("unsubscribe", unsubscribe.serialize());
+  run_encode("response", response);
+  run_decode("response", response.serialize());
+
+  auto buf = subscribe.serialize();
+  auto hand_serialize_ns = bench::ns_per_op(
+      ITERATIONS, [&](std::size_t) { bench::keep(hand_written::serialize(subscribe)); });
+  auto hand_parse_ns = bench::ns_per_op(
+      ITERATIONS, [&](std::size_t) { bench::keep(hand_written::parse(buf.data())); });
+
+  bench::report("subscribe, hand-written serialize", hand_serialize_ns, "ns/message");
+  bench::report("subscribe, hand-written parse", hand_parse_ns, "ns/message");
+
+  dm::Topic topic{TOPIC};
+  auto int_buf = dm::DeviceMessage<dm::INT>{topic, 1, 2150}.serialize();
+  auto float_buf = dm::DeviceMessage<dm::FLOAT>{topic, 0, 2, 2150}.serialize();
+
+  run_parse("device INT", int_buf);
+  run_parse("device FLOAT", float_buf);
+
+  auto view = *dm::DeviceMessageView::parse(int_buf.data(), int_buf.size());
+  auto notification_ns = bench::ns_per_op(ITERATIONS, [&](std::size_t) {
+    bench::keep(DeviceNotification::serialize("192.168.0.7:4242", view));
+  });
+  bench::report("notification v1, serialize", notification_ns, "ns/message");
+}
@@ -0,0 +1,127 @@
+/*
+ * Throughput of the UDP ingest for an increasing number of shards: datagrams are sent over the
+ * loopback interface by several threads, and counted once routed on the event loop thread.
+ *
+ * Every shard count runs in a process of its own, so its threads and event sources are gone once
+ * it is measured. Shards only scale with the number of cores left to them by the senders.
+ */
+
+#include "bench/bench.h"
+#include "commons/device_messages.h"
+#include "gateway/input_endpoint.h"
+#include "microloop/event_loop.h"
+#include "net_utils/buffer_pool.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+constexpr std::uint16_t PORT = 18500;
+constexpr std::size_t SENDERS = 4;
+constexpr std::size_t SEND_BATCH = 64;
+constexpr std::size_t HANDOFF_CAPACITY = 16384;
+constexpr std::chrono::seconds DURATION{2};
+
+/* Send copies of \p datagram to the port until \p stopping is set. */
+void send_until(const microloop::Buffer &datagram, const std::atomic<bool> &stopping)
+{
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  connect(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+
+  iovec iov{const_cast<void *>(datagram.data()), datagram.size()};
+
+  std::vector<mmsghdr> msgs(SEND_BATCH);
+  for (auto &msg : msgs)
+  {
+    msg.msg_hdr.msg_iov = &iov;
+    msg.msg_hdr.msg_iovlen = 1;
+  }
+
+  while (!stopping.load(std::memory_order_relaxed))
+  {
+    sendmmsg(sock, msgs.data(), msgs.size(), 0);
+  }
+
+  close(sock);
+}
+
+void run(std::size_t shards)
+{
+  using commons::device_messages::DeviceMessage;
+  using commons::device_messages::PayloadType;
+
+  std::uint64_t routed = 0;
+
+  gateway::endpoint::InputEndpoint endpoint{PORT, 64, shards, HANDOFF_CAPACITY};
+  endpoint.subscribe([&routed](auto &&, auto &&) { routed++; });
+
+  auto datagram = DeviceMessage<PayloadType::INT>{"plant3/line2/temp", 1, 42}.serialize();
+
+  std::atomic<bool> stopping{false};
+  std::vector<std::thread> senders;
+  for (std::size_t i = 0; i < SENDERS; i++)
+  {
+    senders.emplace_back(send_until, std::cref(datagram), std::cref(stopping));
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  while (std::chrono::steady_clock::now() - start < DURATION)
+  {
+    MICROLOOP_TICK();
+  }
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  stopping = true;
+  for (auto &t : senders)
+  {
+    t.join();
+  }
+
+  /* Buffers are recycled by the thread that receives them, so allocations should stay rare. */
+  auto pool = net_utils::BufferPool::total_stats();
+  auto allocated = 1000.0 * pool.misses / std::max<std::uint64_t>(routed, 1);
+
+  auto label = shards ? std::to_string(shards) + " shards" : std::string{"event loop thread"};
+  bench::report(label + ", routed", routed / elapsed.count(), "msg/s");
+  bench::report(label + ", dropped on hand-off", endpoint.handoff_dropped() / elapsed.count(),
+      "msg/s");
+  bench::report(label + ", buffers allocated", allocated, "per 1000 msg");
+}
+
+}  // namespace
+
+int main()
+{
+  auto cores = std::thread::hardware_concurrency();
+  std::printf("ingest, %zu sender threads, %u cores\n", SENDERS, cores);
+
+  for (std::size_t shards : {0, 1, 2, 4, 8})
+  {
+    std::fflush(stdout);
+    if (fork() == 0)
+    {
+      run(shards);
+      std::fflush(stdout);
+      _exit(0);
+    }
+
+    wait(nullptr);
+  }
+}
@@ -0,0 +1,129 @@
+/*
+ * Lookups of a subscriber by file descriptor, done for every read from its connection, and by
+ * client identifier, done when it greets or is subscribed to. The indexed subscribers storage is
+ * compared against the scan of all the connections it replaced, up to 100k clients.
+ *
+ * Every other client is disconnected and kept for its Store&Forward subscription, so that the
+ * lookups by identifier also reach inactive clients.
+ */
+
+#include "bench/bench.h"
+#include "commons/subscriber_messages.h"
+#include "gateway/subscribers_storage.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+constexpr std::size_t LOOKUPS = 1000000;
+
+/* The connections as they used to be stored, scanned for every lookup. */
+struct ScannedStorage
+{
+  struct Client
+  {
+    std::uint32_t fd;
+    std::string client_id;
+  };
+
+  const Client *with_fd(std::uint32_t fd) const
+  {
+    for (auto &c : clients)
+    {
+      if (c.fd == fd)
+      {
+        return &c;
+      }
+    }
+
+    return nullptr;
+  }
+
+  const Client *named(const std::string &id) const
+  {
+    for (auto &c : clients)
+    {
+      if (c.client_id == id)
+      {
+        return &c;
+      }
+    }
+
+    return nullptr;
+  }
+
+  std::vector<Client> clients;
+};
+
+}  // namespace
+
+int main()
+{
+  using commons::subscriber_messages::SubscribeRequest;
+
+  std::printf("subscriber lookups, half of the clients inactive\n");
+
+  for (std::size_t clients : {1000, 10000, 100000})
+  {
+    auto peers = bench::make_peers(clients);
+    gateway::SubscribersStorage indexed;
+    ScannedStorage scanned;
+
+    std::vector<std::string> ids;
+    for (std::size_t c = 0; c < clients; c++)
+    {
+      ids.push_back("client" + std::to_string(c));
+    }
+
+    auto attach_ns = bench::ns_per_op(clients, [&](std::size_t c) {
+      indexed.register_unnamed_client(peers[c]);
+      bench::keep(indexed.attach_client_id(peers[c], ids[c]));
+    });
+
+    for (std::size_t c = 0; c < clients; c++)
+    {
+      scanned.clients.push_back({peers[c].fd(), ids[c]});
+      if (c % 2)
+      {
+        indexed.add_subscription(ids[c], SubscribeRequest{"topic", true});
+        indexed.disconnect(peers[c]);
+      }
+    }
+
+    /* Clients are looked up in random order, as their messages arrive. */
+    std::mt19937 rng(1);
+    std::vector<std::size_t> order(clients);
+    for (auto &c : order)
+    {
+      c = rng() % clients;
+    }
+
+    auto fd_ns = bench::ns_per_op(LOOKUPS, [&](std::size_t i) {
+      bench::keep(indexed.with_fd(peers[order[i % clients]].fd()));
+    });
+
+    auto named_ns = bench::ns_per_op(LOOKUPS, [&](std::size_t i) {
+      bench::keep(indexed.named(ids[order[i % clients]], true));
+    });
+
+    /* The scans go through half of the clients on average, so they are only run a few times. */
+    auto scan_runs = std::max<std::size_t>(100, 100000000 / clients);
+    auto scan_fd_ns = bench::ns_per_op(scan_runs, [&](std::size_t i) {
+      bench::keep(scanned.with_fd(peers[order[i % clients]].fd()));
+    });
+
+    auto scan_named_ns = bench::ns_per_op(
+        scan_runs, [&](std::size_t i) { bench::keep(scanned.named(ids[order[i % clients]])); });
+
+    auto label = std::to_string(clients) + " clients";
+    bench::report(label + ", by fd", fd_ns, "ns/lookup");
+    bench::report(label + ", by fd, full scan", scan_fd_ns, "ns/lookup");
+    bench::report(label + ", by identifier", named_ns, "ns/lookup");
+    bench::report(label + ", by identifier, full scan", scan_named_ns, "ns/lookup");
+    bench::report(label + ", attach", attach_ns, "ns/client");
+  }
+}
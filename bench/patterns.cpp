@@ -0,0 +1,103 @@
+/*
+ * Routing of a device message to the subscribers of the patterns matching its topic: the topic
+ * trie against checking every pattern in turn, up to 100k patterns.
+ *
+ * Every topic is matched by the same number of patterns, so a lookup in the trie should cost the
+ * same whatever the total number of patterns, while the scan grows with it.
+ */
+
+#include "bench/bench.h"
+#include "commons/subscriber_messages.h"
+#include "gateway/subscribers_storage.h"
+#include "gateway/topic_trie.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+constexpr std::size_t CLIENTS = 5000;
+constexpr std::size_t LINES_PER_PLANT = 1000;
+constexpr std::size_t TOPICS = 4096;
+
+/* Every tenth line is subscribed to as a whole, the others one level below. */
+std::string pattern_name(std::size_t i)
+{
+  auto line = i % LINES_PER_PLANT;
+  return "plant" + std::to_string(i / LINES_PER_PLANT) + "/line" + std::to_string(line) +
+      (line % 10 ? "/+" : "/#");
+}
+
+}  // namespace
+
+int main()
+{
+  using commons::subscriber_messages::SubscribeRequest;
+
+  std::printf("pattern routing, %zu clients\n", CLIENTS);
+
+  for (std::size_t patterns : {1000, 10000, 100000})
+  {
+    auto peers = bench::make_peers(CLIENTS);
+    gateway::SubscribersStorage storage;
+    std::vector<std::string> ids;
+
+    for (std::size_t c = 0; c < CLIENTS; c++)
+    {
+      ids.push_back("client" + std::to_string(c));
+      storage.register_unnamed_client(peers[c]);
+      storage.attach_client_id(peers[c], ids.back());
+    }
+
+    std::vector<std::string> names;
+    for (std::size_t i = 0; i < patterns; i++)
+    {
+      names.push_back(pattern_name(i));
+    }
+
+    auto subscribe_ns = bench::ns_per_op(patterns, [&](std::size_t i) {
+      bench::keep(storage.add_subscription(ids[i % CLIENTS], SubscribeRequest{names[i], false}));
+    });
+
+    std::mt19937 rng(1);
+    std::vector<std::string> topics;
+    auto plants = (patterns + LINES_PER_PLANT - 1) / LINES_PER_PLANT;
+    for (std::size_t t = 0; t < TOPICS; t++)
+    {
+      auto line = rng() % std::min(patterns, LINES_PER_PLANT);
+      topics.push_back("plant" + std::to_string(rng() % plants) + "/line" + std::to_string(line) +
+          "/temp");
+    }
+
+    std::vector<const gateway::TopicSubscriber *> matched;
+    auto trie_ns = bench::ns_per_op(1000000, [&](std::size_t i) {
+      storage.match(topics[i % TOPICS], matched);
+      bench::keep(matched.size());
+    });
+
+    /* The scan checks every pattern for every message, so it is only run a few times. */
+    auto scan_runs = std::max<std::size_t>(3, 10000000 / patterns);
+    auto scan_ns = bench::ns_per_op(scan_runs, [&](std::size_t i) {
+      std::size_t count = 0;
+      for (auto &pattern : names)
+      {
+        count += gateway::TopicTrie::matches(pattern, topics[i % TOPICS]);
+      }
+
+      bench::keep(count);
+    });
+
+    auto unsubscribe_ns = bench::ns_per_op(patterns, [&](std::size_t i) {
+      bench::keep(storage.remove_subscription(ids[i % CLIENTS], names[i]));
+    });
+
+    auto label = std::to_string(patterns) + " patterns";
+    bench::report(label + ", topic trie", trie_ns, "ns/message");
+    bench::report(label + ", full scan", scan_ns, "ns/message");
+    bench::report(label + ", subscribe", subscribe_ns, "ns/pattern");
+    bench::report(label + ", unsubscribe", unsubscribe_ns, "ns/pattern");
+  }
+}
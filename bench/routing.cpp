@@ -0,0 +1,133 @@
+/*
+ * Routing of a device message to the subscribers of its topic: the topic-indexed subscribers
+ * storage against the full scan of all the subscriptions it replaced.
+ *
+ * Every topic has the same number of subscribers, so the index should cost the same whatever the
+ * total number of subscriptions, while the scan grows with it.
+ */
+
+#include "bench/bench.h"
+#include "commons/subscriber_messages.h"
+#include "gateway/subscribers_storage.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+constexpr std::size_t FAN_OUT = 5;
+constexpr std::size_t SUBSCRIPTIONS_PER_CLIENT = 10;
+
+/* The subscriptions as they used to be stored, scanned for every message. */
+struct ScannedStorage
+{
+  struct Client
+  {
+    std::string client_id;
+    bool active;
+  };
+
+  struct Subscription
+  {
+    std::string topic;
+    bool store_forward;
+  };
+
+  /* Linear lookup of a client by identifier, as done for every matching subscription. */
+  Client *named(const std::string &id)
+  {
+    for (auto &c : clients)
+    {
+      if (c.client_id == id)
+      {
+        return &c;
+      }
+    }
+
+    return nullptr;
+  }
+
+  std::size_t route(const std::string &topic)
+  {
+    std::size_t matched = 0;
+    for (auto &[client_id, s] : subscriptions)
+    {
+      auto client = named(client_id);
+      if (s.topic != topic)
+      {
+        continue;
+      }
+
+      matched += client->active;
+    }
+
+    return matched;
+  }
+
+  std::vector<Client> clients;
+  std::multimap<std::string, Subscription> subscriptions;
+};
+
+std::string topic_name(std::size_t i)
+{
+  return "plant" + std::to_string(i % 7) + "/line" + std::to_string(i) + "/temp";
+}
+
+}  // namespace
+
+int main()
+{
+  using commons::subscriber_messages::SubscribeRequest;
+
+  std::printf("routing, %zu subscribers per topic\n", FAN_OUT);
+
+  for (std::size_t clients : {100, 1000, 5000})
+  {
+    auto subscriptions = clients * SUBSCRIPTIONS_PER_CLIENT;
+    auto topics = subscriptions / FAN_OUT;
+
+    auto peers = bench::make_peers(clients);
+    gateway::SubscribersStorage indexed;
+    ScannedStorage scanned;
+
+    for (std::size_t c = 0; c < clients; c++)
+    {
+      auto id = "client" + std::to_string(c);
+
+      indexed.register_unnamed_client(peers[c]);
+      indexed.attach_client_id(peers[c], id);
+      scanned.clients.push_back({id, true});
+
+      for (std::size_t k = 0; k < SUBSCRIPTIONS_PER_CLIENT; k++)
+      {
+        auto topic = topic_name((c + k * clients) % topics);
+
+        indexed.add_subscription(id, SubscribeRequest{topic, false});
+        scanned.subscriptions.emplace(id, ScannedStorage::Subscription{topic, false});
+      }
+    }
+
+    std::vector<std::string> names;
+    for (std::size_t t = 0; t < topics; t++)
+    {
+      names.push_back(topic_name(t));
+    }
+
+    std::vector<const gateway::TopicSubscriber *> matched;
+    auto index_ns = bench::ns_per_op(1000000, [&](std::size_t i) {
+      indexed.match(names[i % topics], matched);
+      bench::keep(matched.size());
+    });
+
+    /* The scan looks every client up for every subscription, so it is only run a few times. */
+    auto scan_runs = std::max<std::size_t>(3, 100000000 / (subscriptions * clients));
+    auto scan_ns = bench::ns_per_op(
+        scan_runs, [&](std::size_t i) { bench::keep(scanned.route(names[i % topics])); });
+
+    auto label = std::to_string(subscriptions) + " subscriptions";
+    bench::report(label + ", topic index", index_ns, "ns/message");
+    bench::report(label + ", full scan", scan_ns, "ns/message");
+  }
+}
@@ -0,0 +1,116 @@
+/*
+ * A disconnect/reconnect storm: every client drops its connection, then greets again and renews
+ * the subscriptions it did not keep through Store&Forward, as after a network outage.
+ *
+ * Subscriptions are owned by their client, so the cost of a disconnect or of a reconnect should
+ * depend on the subscriptions of the client only, and not on the number of clients.
+ */
+
+#include "bench/bench.h"
+#include "commons/subscriber_messages.h"
+#include "gateway/subscribers_storage.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+constexpr std::size_t SUBSCRIPTIONS_PER_CLIENT = 10;
+constexpr std::size_t TOPICS = 1000;
+constexpr std::size_t ROUNDS = 3;
+
+std::string topic_name(std::size_t client, std::size_t k)
+{
+  return "room/" + std::to_string((client * 7 + k * 131) % TOPICS);
+}
+
+/* The first subscription of a client is kept through Store&Forward, the others are renewed. */
+void subscribe(gateway::SubscribersStorage &storage,
+    const std::string &id,
+    std::size_t client,
+    bool renewed_only)
+{
+  using commons::subscriber_messages::SubscribeRequest;
+
+  for (std::size_t k = renewed_only ? 1 : 0; k < SUBSCRIPTIONS_PER_CLIENT; k++)
+  {
+    storage.add_subscription(id, SubscribeRequest{topic_name(client, k), k == 0});
+  }
+}
+
+std::size_t count_matches(const gateway::SubscribersStorage &storage)
+{
+  std::vector<const gateway::TopicSubscriber *> matched;
+
+  std::size_t count = 0;
+  for (std::size_t t = 0; t < TOPICS; t++)
+  {
+    storage.match("room/" + std::to_string(t), matched);
+    count += matched.size();
+  }
+
+  return count;
+}
+
+}  // namespace
+
+int main()
+{
+  using Clock = std::chrono::steady_clock;
+  using Nanoseconds = std::chrono::duration<double, std::nano>;
+
+  std::printf("disconnect/reconnect storm, %zu subscriptions per client\n",
+      SUBSCRIPTIONS_PER_CLIENT);
+
+  for (std::size_t clients : {1000, 10000, 100000})
+  {
+    auto peers = bench::make_peers(clients);
+    gateway::SubscribersStorage storage;
+
+    std::vector<std::string> ids;
+    for (std::size_t c = 0; c < clients; c++)
+    {
+      ids.push_back("client" + std::to_string(c));
+      storage.register_unnamed_client(peers[c]);
+      storage.attach_client_id(peers[c], ids[c]);
+      subscribe(storage, ids[c], c, false);
+    }
+
+    auto matches = count_matches(storage);
+
+    Nanoseconds disconnect{0};
+    Nanoseconds reconnect{0};
+    for (std::size_t round = 0; round < ROUNDS; round++)
+    {
+      auto start = Clock::now();
+      for (auto &peer : peers)
+      {
+        storage.disconnect(peer);
+      }
+
+      auto disconnected = Clock::now();
+      for (std::size_t c = 0; c < clients; c++)
+      {
+        storage.register_unnamed_client(peers[c]);
+        storage.attach_client_id(peers[c], ids[c]);
+        subscribe(storage, ids[c], c, true);
+      }
+
+      disconnect += disconnected - start;
+      reconnect += Clock::now() - disconnected;
+    }
+
+    /* A storm must leave every client with the subscriptions it had before. */
+    if (count_matches(storage) != matches)
+    {
+      std::printf("%zu clients: subscriptions lost in the storm\n", clients);
+      return 1;
+    }
+
+    auto label = std::to_string(clients) + " clients";
+    bench::report(label + ", disconnect", disconnect.count() / (ROUNDS * clients), "ns/client");
+    bench::report(label + ", reconnect", reconnect.count() / (ROUNDS * clients), "ns/client");
+  }
+}
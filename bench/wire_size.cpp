@@ -0,0 +1,91 @@
+/*
+ * Bytes sent to a subscriber for every notification, for each protocol version, along with the
+ * responses to its requests.
+ *
+ * Version 1 pads topics to 50 bytes and device addresses to their longest textual form, version 2
+ * prefixes both with their lengths, and version 3 replaces the topic with an identifier defined
+ * once per connection. The cost of that definition is shared by the notifications of the topic.
+ */
+
+#include "bench/bench.h"
+#include "commons/device_messages.h"
+#include "commons/subscriber_messages.h"
+#include "net_utils/address_wrapper.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+constexpr const char *DEVICE_ADDRESS = "192.168.0.7:4242";
+
+/* A short topic, and one of a typical hierarchy. */
+constexpr const char *TOPICS[][2] = {
+    {"short", "temp"},
+    {"long", "plant3/line12/oven4/temperature"},
+};
+
+/* Notifications of a topic over a connection, sharing the definition of its identifier. */
+constexpr std::size_t NOTIFICATIONS_PER_TOPIC = 100;
+
+struct Sample
+{
+  std::string name;
+  microloop::Buffer message;
+};
+
+std::vector<Sample> make_samples(const std::string &topic)
+{
+  using namespace commons::device_messages;
+
+  Topic name{topic};
+
+  std::vector<Sample> samples;
+  samples.push_back(Sample{"INT", DeviceMessage<INT>{name, 0, 2150}.serialize()});
+  samples.push_back(Sample{"SHORT_REAL", DeviceMessage<SHORT_REAL>{name, 2150}.serialize()});
+  samples.push_back(Sample{"FLOAT", DeviceMessage<FLOAT>{name, 0, 2, 2150}.serialize()});
+  samples.push_back(Sample{"STRING", DeviceMessage<STRING>{name, "badge 4711"}.serialize()});
+
+  return samples;
+}
+
+}  // namespace
+
+int main()
+{
+  using namespace commons::subscriber_messages;
+  using commons::device_messages::DeviceMessageView;
+  using commons::server_response::StatusCode;
+
+  std::uint8_t address[net_utils::AddressWrapper::bin_size];
+  net_utils::AddressWrapper::str_to_binary(DEVICE_ADDRESS, address);
+
+  for (auto [label, topic] : TOPICS)
+  {
+    auto definition = TopicDefinition{1, Topic{topic}}.serialize();
+
+    for (auto &sample : make_samples(topic))
+    {
+      auto msg = *DeviceMessageView::parse(sample.message.data(), sample.message.size());
+
+      auto v1 = DeviceNotification::serialize(DEVICE_ADDRESS, msg).size();
+      auto v2 = DeviceNotification::serialize_v2(address, msg).size();
+      auto v3 = DeviceNotification::serialize_tagged(address, 1, msg).size() +
+          static_cast<double>(definition.size()) / NOTIFICATIONS_PER_TOPIC;
+
+      auto name = sample.name + ", " + label + " topic";
+      bench::report(name + ", v1", v1, "B");
+      bench::report(name + ", v2", v2, "B");
+      bench::report(name + ", v3", v3, "B");
+    }
+  }
+
+  ServerResponse response{StatusCode::SUBSCRIBE_SUCCESSFUL, "plant3/line12/oven4/temperature"};
+  for (auto version : {PROTOCOL_V1, PROTOCOL_V2, PROTOCOL_V3})
+  {
+    auto name = "subscribe response, v" + std::to_string(version);
+    bench::report(name, response.serialize(version).size(), "B");
+  }
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "commons/inline_string.h"
 #include "microloop/buffer.h"
 
 #include <cmath>
@@ -7,13 +8,21 @@
 #include <cstring>
 #include <iomanip>
 #include <limits>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <variant>
 
 namespace commons::device_messages
 {
 
+/* Maximum size of a topic, in bytes. */
+constexpr std::size_t TOPIC_MAXLEN = 50;
+
+/* A topic, stored inline. */
+using Topic = InlineString<TOPIC_MAXLEN>;
+
 enum PayloadType
 {
   INT,
@@ -29,7 +38,7 @@ struct DeviceMessage;
 template <>
 struct DeviceMessage<PayloadType::INT>
 {
-  std::string topic;
+  Topic topic;
 
   /* Sign byte for the value. 0 is positive, 1 is negative. */
   std::uint8_t sign;
@@ -53,12 +62,18 @@ struct DeviceMessage<PayloadType::INT>
   }
 
   microloop::Buffer serialize() const;
+
+  /* Size in bytes of the serialized representation of this message. */
+  std::size_t serialized_size() const;
+
+  /* Serialize this message into \p dest, which must hold at least `serialized_size()` bytes. */
+  void serialize_into(std::uint8_t *dest) const;
 };
 
 template <>
 struct DeviceMessage<PayloadType::SHORT_REAL>
 {
-  std::string topic;
+  Topic topic;
 
   /* The value stored in this message multiplied by 100. */
   std::uint16_t value;
@@ -93,12 +108,18 @@ struct DeviceMessage<PayloadType::SHORT_REAL>
   }
 
   microloop::Buffer serialize() const;
+
+  /* Size in bytes of the serialized representation of this message. */
+  std::size_t serialized_size() const;
+
+  /* Serialize this message into \p dest, which must hold at least `serialized_size()` bytes. */
+  void serialize_into(std::uint8_t *dest) const;
 };
 
 template <>
 struct DeviceMessage<PayloadType::FLOAT>
 {
-  std::string topic;
+  Topic topic;
   std::uint8_t sign;
   std::uint8_t float_size;
   std::uint32_t abs_val;
@@ -134,12 +155,18 @@ struct DeviceMessage<PayloadType::FLOAT>
   }
 
   microloop::Buffer serialize() const;
+
+  /* Size in bytes of the serialized representation of this message. */
+  std::size_t serialized_size() const;
+
+  /* Serialize this message into \p dest, which must hold at least `serialized_size()` bytes. */
+  void serialize_into(std::uint8_t *dest) const;
 };
 
 template <>
 struct DeviceMessage<PayloadType::STRING>
 {
-  std::string topic;
+  Topic topic;
   std::string value;
 
   std::string value_repr() const
@@ -155,6 +182,12 @@ struct DeviceMessage<PayloadType::STRING>
   }
 
   microloop::Buffer serialize() const;
+
+  /* Size in bytes of the serialized representation of this message. */
+  std::size_t serialized_size() const;
+
+  /* Serialize this message into \p dest, which must hold at least `serialized_size()` bytes. */
+  void serialize_into(std::uint8_t *dest) const;
 };
 
 using GenericDeviceMessage = std::variant<DeviceMessage<PayloadType::INT>,
@@ -162,8 +195,75 @@ using GenericDeviceMessage = std::variant<DeviceMessage<PayloadType::INT>,
     DeviceMessage<PayloadType::FLOAT>,
     DeviceMessage<PayloadType::STRING>>;
 
+/**
+ * \brief Non-owning view of a serialized device message.
+ *
+ * The topic and payload point into the buffer the message was parsed from, and numeric fields are
+ * only decoded when the message is materialized. A view must not outlive its buffer, so messages
+ * that need to be kept around must be materialized, or copied in their serialized form.
+ */
+class DeviceMessageView
+{
+public:
+  /**
+   * \brief Parse a serialized device message without copying any of its data.
+   * \returns The parsed view, or an empty optional if the buffer does not hold a valid message.
+   */
+  static std::optional<DeviceMessageView> parse(const void *data, std::size_t n);
+
+  /**
+   * \brief Read the topic of a serialized device message, without validating the rest of it. Meant
+   * to discard unwanted datagrams before parsing them.
+   * \returns The topic, or an empty optional if the buffer is too short to hold a message.
+   */
+  static std::optional<std::string_view> peek_topic(const void *data, std::size_t n);
+
+  /**
+   * \brief Build a view from the fields of a device message, which were encoded separately.
+   * \returns The view, or an empty optional if the fields do not make up a valid message.
+   */
+  static std::optional<DeviceMessageView> from_parts(std::string_view topic,
+      std::uint8_t type,
+      std::string_view payload);
+
+  std::string_view topic() const
+  {
+    return topic_;
+  }
+
+  PayloadType type() const
+  {
+    return type_;
+  }
+
+  /* The raw payload, with numeric fields in network byte order. */
+  std::string_view payload() const
+  {
+    return payload_;
+  }
+
+  /* Build an owning, type-safe copy of this message. */
+  GenericDeviceMessage materialize() const;
+
+  /* Size in bytes of the serialized representation of this message. */
+  std::size_t serialized_size() const;
+
+  /* Serialize this message into \p dest, which must hold at least `serialized_size()` bytes. */
+  void serialize_into(std::uint8_t *dest) const;
+
+private:
+  DeviceMessageView(std::string_view topic, PayloadType type, std::string_view payload) :
+      topic_{topic}, type_{type}, payload_{payload}
+  {}
+
+  std::string_view topic_;
+  PayloadType type_;
+  std::string_view payload_;
+};
+
 /**
  * \brief Retrieve a type-safe representation of a device message from the serialized buffer.
+ * \throws std::runtime_error If the buffer does not hold a valid device message.
  */
 GenericDeviceMessage from_buffer(const microloop::Buffer &buf);
 GenericDeviceMessage from_buffer(const void *data, std::size_t n);
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "commons/subscriber_messages.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace commons::subscriber_messages
+{
+
+/**
+ * \brief Incremental decoder splitting a TCP byte stream into subscriber protocol messages.
+ *
+ * Whole messages are handed out straight from the buffers they were read into. Only a message
+ * split across reads is copied, into a reassembly buffer which is reused for the whole lifetime of
+ * the decoder, so the stream is never shifted around. Once a malformed message is found, the
+ * stream cannot be synchronized again.
+ *
+ * Messages are decoded as version 1 messages, until another protocol version is negotiated.
+ */
+class FrameDecoder
+{
+public:
+  /* The largest message header, among all protocol versions. */
+  static constexpr std::size_t MAX_HEADER_SIZE = 4;
+
+  /**
+   * \brief Decode the messages in the next \p n bytes of the stream.
+   *
+   * \p on_frame is invoked as `bool(const std::uint8_t *frame, std::size_t size)` for every whole
+   * message, which has a valid header. Decoding stops as soon as it returns `false`.
+   *
+   * \returns Whether decoding may go on, i.e. `false` if a message is malformed, or if \p on_frame
+   * stopped the decoding.
+   */
+  template <class Func>
+  bool feed(const void *data, std::size_t n, Func &&on_frame)
+  {
+    auto bytes = static_cast<const std::uint8_t *>(data);
+
+    /* Complete the message left partial by the previous reads first. */
+    if (partial_size_ != 0)
+    {
+      auto taken = fill_partial(bytes, n);
+      bytes += taken;
+      n -= taken;
+
+      if (malformed_ || partial_frame_size_ == 0 || partial_size_ < partial_frame_size_)
+      {
+        return !malformed_;
+      }
+
+      auto size = partial_frame_size_;
+      partial_size_ = 0;
+      partial_frame_size_ = 0;
+
+      if (!on_frame(partial_.data(), size))
+      {
+        return false;
+      }
+    }
+
+    /* The version is looked up for every message, as a message may switch to another version. */
+    while (n != 0)
+    {
+      auto size = frame_size(bytes, n, version_);
+      if (!size)
+      {
+        break;
+      }
+
+      if (*size == 0)
+      {
+        malformed_ = true;
+        return false;
+      }
+
+      if (n < *size)
+      {
+        break;
+      }
+
+      if (!on_frame(bytes, *size))
+      {
+        return false;
+      }
+
+      bytes += *size;
+      n -= *size;
+    }
+
+    /* Keep the beginning of the last message, which is still incomplete. */
+    if (n != 0)
+    {
+      fill_partial(bytes, n);
+    }
+
+    return true;
+  }
+
+  /* The protocol version of the messages to be decoded next. */
+  std::uint8_t version() const
+  {
+    return version_;
+  }
+
+  void set_version(std::uint8_t version)
+  {
+    version_ = version;
+  }
+
+  /* Whether a malformed message was found in the stream. */
+  bool malformed() const
+  {
+    return malformed_;
+  }
+
+  /* Number of bytes of the partial message waiting for the next reads. */
+  std::size_t buffered() const
+  {
+    return partial_size_;
+  }
+
+private:
+  /**
+   * \brief Copy the beginning of \p bytes into the partial message, up to its end.
+   * \returns How many bytes were copied.
+   */
+  std::size_t fill_partial(const std::uint8_t *bytes, std::size_t n);
+
+private:
+  std::uint8_t version_ = PROTOCOL_V1;
+
+  std::vector<std::uint8_t> partial_ = std::vector<std::uint8_t>(MAX_HEADER_SIZE);
+  std::size_t partial_size_ = 0;
+
+  /* Size of the partial message, known as soon as its header is complete, zero until then. */
+  std::size_t partial_frame_size_ = 0;
+
+  bool malformed_ = false;
+};
+
+}  // namespace commons::subscriber_messages
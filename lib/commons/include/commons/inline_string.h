@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace commons
+{
+
+/**
+ * \brief String of at most \p N bytes, stored inline, for the bounded text fields of the protocol
+ * messages. Messages holding such fields are parsed and copied without allocating.
+ *
+ * Strings longer than \p N bytes are truncated, the same way their serialized form would be.
+ */
+template <std::size_t N>
+class InlineString
+{
+  static_assert(N <= UINT8_MAX, "The size of an inline string must fit in a byte");
+
+  /* Enabled for the types viewable as a string, other than inline strings of this capacity. */
+  template <class T>
+  using Viewable = std::enable_if_t<std::is_convertible_v<const T &, std::string_view> &&
+      !std::is_same_v<T, InlineString>>;
+
+public:
+  static constexpr std::size_t capacity()
+  {
+    return N;
+  }
+
+  InlineString() = default;
+
+  InlineString(std::string_view str)
+  {
+    assign(str);
+  }
+
+  InlineString(const std::string &str) : InlineString{std::string_view{str}}
+  {}
+
+  InlineString(const char *str) : InlineString{std::string_view{str}}
+  {}
+
+  template <std::size_t M>
+  InlineString(const InlineString<M> &other) : InlineString{other.view()}
+  {}
+
+  void assign(std::string_view str)
+  {
+    size_ = static_cast<std::uint8_t>(std::min(str.size(), N));
+    std::memcpy(data_, str.data(), size_);
+  }
+
+  const char *data() const
+  {
+    return data_;
+  }
+
+  std::size_t size() const
+  {
+    return size_;
+  }
+
+  bool empty() const
+  {
+    return size_ == 0;
+  }
+
+  const char *begin() const
+  {
+    return data_;
+  }
+
+  const char *end() const
+  {
+    return data_ + size_;
+  }
+
+  std::string_view view() const
+  {
+    return std::string_view{data_, size_};
+  }
+
+  operator std::string_view() const
+  {
+    return view();
+  }
+
+  /* Build an owning copy of the string, which may allocate. */
+  std::string str() const
+  {
+    return std::string{view()};
+  }
+
+  friend bool operator==(const InlineString &a, const InlineString &b)
+  {
+    return a.view() == b.view();
+  }
+
+  friend bool operator!=(const InlineString &a, const InlineString &b)
+  {
+    return !(a == b);
+  }
+
+  /* Comparisons with anything viewable as a string, without converting it to an inline string. */
+  template <class T, class = Viewable<T>>
+  friend bool operator==(const InlineString &a, const T &b)
+  {
+    return a.view() == std::string_view{b};
+  }
+
+  template <class T, class = Viewable<T>>
+  friend bool operator==(const T &a, const InlineString &b)
+  {
+    return std::string_view{a} == b.view();
+  }
+
+  template <class T, class = Viewable<T>>
+  friend bool operator!=(const InlineString &a, const T &b)
+  {
+    return !(a == b);
+  }
+
+  template <class T, class = Viewable<T>>
+  friend bool operator!=(const T &a, const InlineString &b)
+  {
+    return !(a == b);
+  }
+
+  friend std::ostream &operator<<(std::ostream &os, const InlineString &s)
+  {
+    return os << s.view();
+  }
+
+private:
+  std::uint8_t size_ = 0;
+  char data_[N];
+};
+
+}  // namespace commons
@@ -17,6 +17,8 @@ enum StatusCode : std::uint8_t
   UNSUBSCRIBE_SUCCESSFUL,
   DUPLICATE_SUBSCRIPTION,
   SUBSCRIPTION_NOT_FOUND,
+  MALFORMED_MSG,
+  INVALID_TOPIC,
 };
 
 static std::string status_str(StatusCode c)
@@ -41,6 +43,10 @@ static std::string status_str(StatusCode c)
     return "Already subscribed.";
   case SUBSCRIPTION_NOT_FOUND:
     return "Subscription not found.";
+  case MALFORMED_MSG:
+    return "Malformed message.";
+  case INVALID_TOPIC:
+    return "Invalid topic pattern.";
   default:
     __builtin_unreachable();
   }
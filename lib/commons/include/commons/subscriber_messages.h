@@ -5,8 +5,12 @@
 #include "microloop/buffer.h"
 
 #include <cstdint>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <variant>
+#include <vector>
 
 namespace commons::subscriber_messages
 {
@@ -18,9 +22,37 @@ enum MessageType : std::uint8_t
   UNSUBSCRIBE,
   RESPONSE,
   DEVICE_MSG,
+  BULK_SUBSCRIBE,
+  BULK_UNSUBSCRIBE,
+  BULK_RESPONSE,
+  TOPIC_DEFINITION,
+  TAGGED_DEVICE_MSG,
+  SNAPSHOT,
   _COUNT,  // End of valid messages from client.
 };
 
+/*
+ * Versions of the encoding of the messages sent by the Gateway, negotiated through the greeting.
+ * Subscribers always send their requests using the version 1 encoding.
+ */
+constexpr std::uint8_t PROTOCOL_V1 = 1;
+constexpr std::uint8_t PROTOCOL_V2 = 2;
+constexpr std::uint8_t PROTOCOL_V3 = 3;
+constexpr std::uint8_t PROTOCOL_LATEST = PROTOCOL_V3;
+
+/* Maximum size of a client identifier, in bytes. */
+constexpr std::size_t CLIENT_ID_MAXLEN = 10;
+
+/* Maximum size of the notes of a response, in bytes. */
+constexpr std::size_t NOTES_MAXLEN = 64;
+
+using device_messages::Topic;
+using ClientId = InlineString<CLIENT_ID_MAXLEN>;
+using Notes = InlineString<NOTES_MAXLEN>;
+
+/* Number of topic identifiers available to the Gateway when using protocol version 3. */
+constexpr std::uint32_t TOPIC_ID_COUNT = 0x10000;
+
 /**
  * \brief Message to be retrieved from subscriber clients upon connection initiation. This message
  * is similar to a handshake, including client identification data.
@@ -28,10 +60,25 @@ enum MessageType : std::uint8_t
 struct GreetingMessage
 {
   /* Client ID string. No more than 10 characters. */
-  std::string client_id;
+  ClientId client_id;
+
+  /*
+   * The latest protocol version supported by the client. Version 1 greetings do not carry it, so
+   * older clients keep working unchanged.
+   */
+  std::uint8_t version = PROTOCOL_V1;
 
   /* Create a buffer from this message to be sent over the network. */
   microloop::Buffer serialize() const;
+
+  /* Size in bytes of the serialized representation of this message. */
+  std::size_t serialized_size() const;
+
+  /**
+   * \brief Serialize this message into \p dest, which holds \p n bytes, without allocating.
+   * \returns The number of bytes written, or zero if \p n is less than `serialized_size()`.
+   */
+  std::size_t serialize_into(void *dest, std::size_t n) const;
 };
 
 /**
@@ -41,13 +88,28 @@ struct GreetingMessage
 struct SubscribeRequest
 {
   /* The topic to subscribe the client to. */
-  std::string topic;
+  Topic topic;
 
   /* Whether to enable Store and Forward mechanism for this subscription. */
   bool store_forward;
 
+  /*
+   * Whether only the latest notification of the topic matters, so a slow connection gets fresh
+   * notifications instead of a backlog. Requires a Gateway supporting it.
+   */
+  bool conflate = false;
+
   /* Create a buffer from this message to be sent over the network. */
   microloop::Buffer serialize() const;
+
+  /* Size in bytes of the serialized representation of this message. */
+  std::size_t serialized_size() const;
+
+  /**
+   * \brief Serialize this message into \p dest, which holds \p n bytes, without allocating.
+   * \returns The number of bytes written, or zero if \p n is less than `serialized_size()`.
+   */
+  std::size_t serialize_into(void *dest, std::size_t n) const;
 };
 
 /**
@@ -59,12 +121,75 @@ struct SubscribeRequest
 struct UnsubscribeRequest
 {
   /* The topic to unsubscribe the client from. */
-  std::string topic;
+  Topic topic;
+
+  /* Create a buffer from this message to be sent over the network. */
+  microloop::Buffer serialize() const;
+
+  /* Size in bytes of the serialized representation of this message. */
+  std::size_t serialized_size() const;
+
+  /**
+   * \brief Serialize this message into \p dest, which holds \p n bytes, without allocating.
+   * \returns The number of bytes written, or zero if \p n is less than `serialized_size()`.
+   */
+  std::size_t serialize_into(void *dest, std::size_t n) const;
+};
+
+/* Maximum number of topics carried by a single bulk request. */
+constexpr std::size_t BULK_MAX_TOPICS = 1024;
 
+/**
+ * \brief Message representing several subscribe requests at once, each with its own Store and
+ * Forward setting. Meant for clients subscribing to many topics upon connection.
+ */
+struct BulkSubscribeRequest
+{
+  /* The subscriptions to be created. No more than `BULK_MAX_TOPICS`. */
+  std::vector<SubscribeRequest> subscriptions;
+
+  /* Create a buffer from this message to be sent over the network. */
+  microloop::Buffer serialize() const;
+};
+
+/**
+ * \brief Message representing several unsubscribe requests at once.
+ */
+struct BulkUnsubscribeRequest
+{
+  /* The topics to unsubscribe the client from. No more than `BULK_MAX_TOPICS`. */
+  std::vector<Topic> topics;
+
+  /* Create a buffer from this message to be sent over the network. */
+  microloop::Buffer serialize() const;
+};
+
+/**
+ * \brief Message asking for the latest notification of every topic the client is subscribed to,
+ * as kept by the last value cache of the Gateway. The Gateway sends the notifications, followed by
+ * an OK response.
+ */
+struct SnapshotRequest
+{
   /* Create a buffer from this message to be sent over the network. */
   microloop::Buffer serialize() const;
 };
 
+/**
+ * \brief Response to a bulk request, telling which of its topics were handled successfully.
+ */
+struct BulkResponse
+{
+  /* The type of the bulk request this is a response to. */
+  MessageType request;
+
+  /* One entry for every topic of the request, in the same order. Sent as a bitmap. */
+  std::vector<bool> results;
+
+  /* Serialize this response into a buffer ready to be sent over the network. */
+  microloop::Buffer serialize(std::uint8_t version = PROTOCOL_V1) const;
+};
+
 /**
  * \brief Response to be sent to subscribers regarding their requests.
  */
@@ -73,11 +198,24 @@ struct ServerResponse
   /* The status code of this response. */
   server_response::StatusCode code;
 
-  /* Optional notes of this response. Will be truncated/extended to exactly 64 bytes. */
-  std::string notes;
+  /*
+   * Optional notes of this response. Truncated to 64 bytes, and extended to exactly 64 bytes by the
+   * version 1 encoding.
+   */
+  Notes notes;
 
   /* Serialize this response into a buffer ready to be sent over the network. */
-  microloop::Buffer serialize() const;
+  microloop::Buffer serialize(std::uint8_t version = PROTOCOL_V1) const;
+
+  /* Size in bytes of the version 1 serialized representation of this response. */
+  std::size_t serialized_size() const;
+
+  /**
+   * \brief Serialize this response into \p dest, which holds \p n bytes, using the version 1
+   * encoding and without allocating.
+   * \returns The number of bytes written, or zero if \p n is less than `serialized_size()`.
+   */
+  std::size_t serialize_into(void *dest, std::size_t n) const;
 };
 
 /**
@@ -92,15 +230,69 @@ struct DeviceNotification
   /* A copy of the original message sent by the device. */
   device_messages::GenericDeviceMessage original_message;
 
+  microloop::Buffer serialize(std::uint8_t version = PROTOCOL_V1) const;
+
+  /**
+   * \brief Serialize a notification straight from a device message view, without building an
+   * owning copy of the message first.
+   */
+  static microloop::Buffer serialize(std::string_view device_address,
+      const device_messages::DeviceMessageView &msg);
+
+  /**
+   * \brief Serialize a notification straight from a device message view, using the version 2
+   * encoding.
+   * \param device_address The device address as obtained from AddressWrapper::to_binary().
+   */
+  static microloop::Buffer serialize_v2(const std::uint8_t *device_address,
+      const device_messages::DeviceMessageView &msg);
+
+  /**
+   * \brief Serialize a notification using the version 3 encoding, where the topic is replaced by
+   * the identifier of a topic defined earlier on the connection.
+   */
+  static microloop::Buffer serialize_tagged(const std::uint8_t *device_address,
+      std::uint32_t topic_id,
+      const device_messages::DeviceMessageView &msg);
+
+  /**
+   * \brief Encode a serialized version 1 notification, as kept by the Store&Forward storage, for a
+   * subscriber using the given protocol version.
+   * \throws std::runtime_error If \p frame does not hold a valid notification.
+   */
+  static microloop::Buffer transcode(const void *frame, std::size_t n, std::uint8_t version);
+};
+
+/**
+ * \brief Message binding a topic to an identifier for the rest of a connection, sent before the
+ * first notification tagged with that identifier. Only exists in protocol version 3.
+ */
+struct TopicDefinition
+{
+  /* The identifier of the topic. Less than `TOPIC_ID_COUNT`. */
+  std::uint32_t id;
+
+  /* The topic being defined. */
+  Topic topic;
+
+  /* Create a buffer from this message to be sent over the network. */
   microloop::Buffer serialize() const;
 };
 
+/* Topics defined on a connection through TopicDefinition messages, by their identifiers. */
+using TopicTable = std::unordered_map<std::uint32_t, std::string>;
+
 /* Message types supported from subscriber clients. */
 using SubscriberMessage = std::variant<GreetingMessage,
     SubscribeRequest,
     UnsubscribeRequest,
     ServerResponse,
-    DeviceNotification>;
+    DeviceNotification,
+    BulkSubscribeRequest,
+    BulkUnsubscribeRequest,
+    BulkResponse,
+    TopicDefinition,
+    SnapshotRequest>;
 
 /**
  * \brief Checks whether the supplied byte represents a valid message type.
@@ -114,18 +306,45 @@ bool is_valid_message_type(uint8_t value);
  */
 bool can_parse_entire_msg(const microloop::Buffer &buf);
 
+/* Size of the header preceding every message exchanged between subscribers and the Gateway. */
+constexpr std::size_t FRAME_HEADER_SIZE = 3;
+
+/**
+ * \brief Validate the header of a serialized message, without looking at its payload.
+ * \param hdr The first `FRAME_HEADER_SIZE` bytes of the message.
+ * \returns The size of the whole message, header included, or zero if the header has an invalid
+ * message type, or a payload size that does not match its message type.
+ */
+std::size_t frame_size(const void *hdr);
+
+/**
+ * \brief Validate the header of a serialized message, encoded using the given protocol version.
+ * \param n The number of bytes available at \p data, which may be less than the whole header.
+ * \returns An empty optional if more bytes are needed to read the header. Otherwise, the same as
+ * the version 1 overload.
+ */
+std::optional<std::size_t> frame_size(const void *data, std::size_t n, std::uint8_t version);
+
 /**
  * \brief Constructs a strongly-typed message structure given a buffer from an incoming network
- * packet.
- *
- * Note that this function does not perform any checks regarding the message type supplied into the
- * buffer. Providing a buffer containing an invalid message type will lead to undefined behavior.
- *
- * Users are required to perform checks using the `is_valid_message_type` function.
+ * packet. The buffer may hold more data past the message.
  *
  * \returns A pair made of the parsed message and how many bytes have been consumed from the given
  * buffer.
+ * \throws std::runtime_error If the buffer does not start with a whole, valid message.
  */
 std::pair<SubscriberMessage, std::size_t> from_buffer(const microloop::Buffer &buf);
+std::pair<SubscriberMessage, std::size_t> from_buffer(const void *data, std::size_t n);
+
+/**
+ * \brief Same as above, for a message encoded using the given protocol version.
+ * \param topics The topics defined so far on the connection, used to resolve tagged notifications
+ * into plain DeviceNotification messages. Topic definitions are returned as they are, and it is up
+ * to the caller to add them to its table.
+ */
+std::pair<SubscriberMessage, std::size_t> from_buffer(const void *data,
+    std::size_t n,
+    std::uint8_t version,
+    const TopicTable *topics = nullptr);
 
 }  // namespace commons::subscriber_messages
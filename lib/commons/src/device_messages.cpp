@@ -2,12 +2,14 @@
 
 #include "messages_internal.h"
 #include "microloop/buffer.h"
+#include "net_utils/buffer_pool.h"
 
 #include <algorithm>
 #include <arpa/inet.h>
 #include <cstdint>
 #include <cstdlib>
 #include <iterator>
+#include <stdexcept>
 
 namespace commons::device_messages
 {
@@ -19,125 +21,273 @@ GenericDeviceMessage from_buffer(const microloop::Buffer &buf)
 
 GenericDeviceMessage from_buffer(const void *buf, std::size_t n)
 {
-  auto data = static_cast<const std::uint8_t *>(buf);
-  auto data_it = data;
+  auto view = DeviceMessageView::parse(buf, n);
+  if (!view)
+  {
+    throw std::runtime_error{"malformed device message"};
+  }
 
-  using commons::internal::topic_maxlen;
-  char topic_buf[topic_maxlen() + 1]{0};
-  std::memcpy(topic_buf, data_it, topic_maxlen());
-  std::string topic{topic_buf};
-  data_it += topic_maxlen();
+  return view->materialize();
+}
 
-  PayloadType type = static_cast<PayloadType>(*data_it++);
+std::optional<DeviceMessageView> DeviceMessageView::parse(const void *buf, std::size_t n)
+{
+  using commons::device_messages::internal::DeviceMessageFloatSchema;
+  using commons::device_messages::internal::DeviceMessageHeaderSchema;
+  using commons::device_messages::internal::DeviceMessageIntSchema;
+  using commons::device_messages::internal::DeviceMessageShortRealSchema;
+  using commons::subscriber_messages::internal::msg_payload_size;
+
+  std::string_view topic;
+  std::uint8_t payload_type;
+  if (!DeviceMessageHeaderSchema::decode(buf, n, topic, payload_type))
+  {
+    return std::nullopt;
+  }
+
+  auto payload = static_cast<const char *>(buf) + DeviceMessageHeaderSchema::size;
+  auto payload_len = n - DeviceMessageHeaderSchema::size;
+  auto type = static_cast<PayloadType>(payload_type);
 
   switch (type)
   {
-  case INT: {
-    std::uint8_t sign = *data_it++;
-    std::uint32_t abs_val = ntohl(*((std::uint32_t *)data_it));
-    return DeviceMessage<INT>{topic, sign, abs_val};
+  case INT:
+    payload_len = DeviceMessageIntSchema::size;
+    break;
+  case SHORT_REAL:
+    payload_len = DeviceMessageShortRealSchema::size;
+    break;
+  case FLOAT:
+    payload_len = DeviceMessageFloatSchema::size;
+    break;
+  case STRING:
+    /* The string ends at the first null byte, if any. */
+    payload_len = strnlen(payload, std::min(payload_len, msg_payload_size()));
+    return DeviceMessageView{topic, type, std::string_view{payload, payload_len}};
+  default:
+    return std::nullopt;
   }
-  case SHORT_REAL: {
-    std::uint16_t value = ntohs(*((std::uint16_t *)data_it));
-    return DeviceMessage<SHORT_REAL>{topic, value};
+
+  if (n - DeviceMessageHeaderSchema::size < payload_len)
+  {
+    return std::nullopt;
+  }
+
+  return DeviceMessageView{topic, type, std::string_view{payload, payload_len}};
+}
+
+std::optional<std::string_view> DeviceMessageView::peek_topic(const void *data, std::size_t n)
+{
+  using commons::device_messages::internal::DeviceMessageHeaderSchema;
+
+  std::string_view topic;
+  std::uint8_t type;
+  if (!DeviceMessageHeaderSchema::decode(data, n, topic, type))
+  {
+    return std::nullopt;
   }
-  case FLOAT: {
-    std::uint8_t sign = *data_it++;
-    std::uint32_t abs_val = ntohl(*((std::uint32_t *)data_it));
-    data_it += sizeof(abs_val);
-    std::uint8_t float_size = *data_it;
 
-    return DeviceMessage<FLOAT>{topic, sign, float_size, abs_val};
+  return topic;
+}
+
+std::optional<DeviceMessageView> DeviceMessageView::from_parts(std::string_view topic,
+    std::uint8_t type,
+    std::string_view payload)
+{
+  using commons::device_messages::internal::DeviceMessageFloatSchema;
+  using commons::device_messages::internal::DeviceMessageIntSchema;
+  using commons::device_messages::internal::DeviceMessageShortRealSchema;
+  using commons::device_messages::internal::topic_maxlen;
+  using commons::subscriber_messages::internal::msg_payload_size;
+
+  if (topic.size() > topic_maxlen())
+  {
+    return std::nullopt;
   }
-  case STRING: {
-    using commons::subscriber_messages::internal::msg_payload_size;
 
-    auto offset = data_it - data;
-    char payload_buf[msg_payload_size() + 1]{};
-    std::memcpy(payload_buf, data_it, std::min<std::size_t>(n - offset, msg_payload_size()));
-    return DeviceMessage<STRING>{topic, std::string{payload_buf}};
+  std::size_t payload_len;
+  switch (type)
+  {
+  case INT:
+    payload_len = DeviceMessageIntSchema::size;
+    break;
+  case SHORT_REAL:
+    payload_len = DeviceMessageShortRealSchema::size;
+    break;
+  case FLOAT:
+    payload_len = DeviceMessageFloatSchema::size;
+    break;
+  case STRING:
+    payload_len = std::min(payload.size(), msg_payload_size());
+    break;
+  default:
+    return std::nullopt;
+  }
+
+  if (payload.size() != payload_len)
+  {
+    return std::nullopt;
+  }
+
+  return DeviceMessageView{topic, static_cast<PayloadType>(type), payload};
+}
+
+GenericDeviceMessage DeviceMessageView::materialize() const
+{
+  using commons::device_messages::internal::DeviceMessageFloatSchema;
+  using commons::device_messages::internal::DeviceMessageIntSchema;
+  using commons::device_messages::internal::DeviceMessageShortRealSchema;
+
+  /* The payload size was checked against the schema of its type by parse() or from_parts(). */
+  switch (type_)
+  {
+  case INT: {
+    std::uint8_t sign;
+    std::uint32_t value;
+    DeviceMessageIntSchema::decode(payload_.data(), payload_.size(), sign, value);
+    return DeviceMessage<INT>{topic_, sign, value};
+  }
+  case SHORT_REAL: {
+    std::uint16_t value;
+    DeviceMessageShortRealSchema::decode(payload_.data(), payload_.size(), value);
+    return DeviceMessage<SHORT_REAL>{topic_, value};
   }
+  case FLOAT: {
+    std::uint8_t sign;
+    std::uint8_t float_size;
+    std::uint32_t abs_val;
+    DeviceMessageFloatSchema::decode(payload_.data(), payload_.size(), sign, abs_val, float_size);
+    return DeviceMessage<FLOAT>{topic_, sign, float_size, abs_val};
+  }
+  case STRING:
+    return DeviceMessage<STRING>{topic_, std::string{payload_}};
   default:
     __builtin_unreachable();
   }
 }
 
-microloop::Buffer DeviceMessage<PayloadType::INT>::serialize() const
+std::size_t DeviceMessageView::serialized_size() const
 {
-  using commons::device_messages::internal::POD_DeviceMessage_Header;
-  using commons::device_messages::internal::POD_DeviceMessage_Int;
-  using commons::internal::topic_maxlen;
+  using commons::device_messages::internal::DeviceMessageHeaderSchema;
 
-  microloop::Buffer buf{sizeof(POD_DeviceMessage_Header) + sizeof(POD_DeviceMessage_Int)};
-  auto data = static_cast<std::uint8_t *>(buf.data());
+  return DeviceMessageHeaderSchema::size + payload_.size();
+}
 
-  POD_DeviceMessage_Header *hdr = reinterpret_cast<POD_DeviceMessage_Header *>(data);
-  std::memcpy(hdr->topic, topic.c_str(), std::min(topic.size(), topic_maxlen()));
-  hdr->payload_type = PayloadType::INT;
+void DeviceMessageView::serialize_into(std::uint8_t *data) const
+{
+  using commons::device_messages::internal::DeviceMessageHeaderSchema;
 
-  auto payload = reinterpret_cast<POD_DeviceMessage_Int *>(data + sizeof(*hdr));
-  payload->sign = sign;
-  payload->value = htonl(value);
+  DeviceMessageHeaderSchema::encode(data, serialized_size(), topic_, type_);
+  std::memcpy(data + DeviceMessageHeaderSchema::size, payload_.data(), payload_.size());
+}
+
+microloop::Buffer DeviceMessage<PayloadType::INT>::serialize() const
+{
+  auto buf = net_utils::BufferPool::local().acquire(serialized_size());
+  serialize_into(static_cast<std::uint8_t *>(buf.data()));
 
   return buf;
 }
 
-microloop::Buffer DeviceMessage<PayloadType::SHORT_REAL>::serialize() const
+std::size_t DeviceMessage<PayloadType::INT>::serialized_size() const
 {
-  using commons::device_messages::internal::POD_DeviceMessage_Header;
-  using commons::device_messages::internal::POD_DeviceMessage_ShortReal;
-  using commons::internal::topic_maxlen;
+  using commons::device_messages::internal::DeviceMessageHeaderSchema;
+  using commons::device_messages::internal::DeviceMessageIntSchema;
 
-  microloop::Buffer buf{sizeof(POD_DeviceMessage_Header) + sizeof(POD_DeviceMessage_ShortReal)};
-  auto data = static_cast<std::uint8_t *>(buf.data());
+  return DeviceMessageHeaderSchema::size + DeviceMessageIntSchema::size;
+}
 
-  POD_DeviceMessage_Header *hdr = reinterpret_cast<POD_DeviceMessage_Header *>(data);
-  std::memcpy(hdr->topic, topic.c_str(), std::min(topic.size(), topic_maxlen()));
-  hdr->payload_type = PayloadType::SHORT_REAL;
+void DeviceMessage<PayloadType::INT>::serialize_into(std::uint8_t *data) const
+{
+  using commons::device_messages::internal::DeviceMessageHeaderSchema;
+  using commons::device_messages::internal::DeviceMessageIntSchema;
+
+  auto payload = data + DeviceMessageHeaderSchema::size;
 
-  auto payload = reinterpret_cast<POD_DeviceMessage_ShortReal *>(data + sizeof(*hdr));
-  payload->value = htons(value);
+  DeviceMessageHeaderSchema::encode(data, serialized_size(), topic, PayloadType::INT);
+  DeviceMessageIntSchema::encode(payload, DeviceMessageIntSchema::size, sign, value);
+}
+
+microloop::Buffer DeviceMessage<PayloadType::SHORT_REAL>::serialize() const
+{
+  auto buf = net_utils::BufferPool::local().acquire(serialized_size());
+  serialize_into(static_cast<std::uint8_t *>(buf.data()));
 
   return buf;
 }
 
-microloop::Buffer DeviceMessage<PayloadType::FLOAT>::serialize() const
+std::size_t DeviceMessage<PayloadType::SHORT_REAL>::serialized_size() const
+{
+  using commons::device_messages::internal::DeviceMessageHeaderSchema;
+  using commons::device_messages::internal::DeviceMessageShortRealSchema;
+
+  return DeviceMessageHeaderSchema::size + DeviceMessageShortRealSchema::size;
+}
+
+void DeviceMessage<PayloadType::SHORT_REAL>::serialize_into(std::uint8_t *data) const
 {
-  using commons::device_messages::internal::POD_DeviceMessage_Float;
-  using commons::device_messages::internal::POD_DeviceMessage_Header;
-  using commons::internal::topic_maxlen;
+  using commons::device_messages::internal::DeviceMessageHeaderSchema;
+  using commons::device_messages::internal::DeviceMessageShortRealSchema;
 
-  microloop::Buffer buf{sizeof(POD_DeviceMessage_Header) + sizeof(POD_DeviceMessage_Float)};
-  auto data = static_cast<std::uint8_t *>(buf.data());
+  auto payload = data + DeviceMessageHeaderSchema::size;
 
-  POD_DeviceMessage_Header *hdr = reinterpret_cast<POD_DeviceMessage_Header *>(data);
-  std::memcpy(hdr->topic, topic.c_str(), std::min(topic.size(), topic_maxlen()));
-  hdr->payload_type = PayloadType::FLOAT;
+  DeviceMessageHeaderSchema::encode(data, serialized_size(), topic, PayloadType::SHORT_REAL);
+  DeviceMessageShortRealSchema::encode(payload, DeviceMessageShortRealSchema::size, value);
+}
 
-  auto payload = reinterpret_cast<POD_DeviceMessage_Float *>(data + sizeof(*hdr));
-  payload->sign = sign;
-  payload->abs_val = htonl(abs_val);
-  payload->float_size = float_size;
+microloop::Buffer DeviceMessage<PayloadType::FLOAT>::serialize() const
+{
+  auto buf = net_utils::BufferPool::local().acquire(serialized_size());
+  serialize_into(static_cast<std::uint8_t *>(buf.data()));
 
   return buf;
 }
 
-microloop::Buffer DeviceMessage<PayloadType::STRING>::serialize() const
+std::size_t DeviceMessage<PayloadType::FLOAT>::serialized_size() const
 {
-  using commons::device_messages::internal::POD_DeviceMessage_Header;
-  using commons::internal::topic_maxlen;
+  using commons::device_messages::internal::DeviceMessageFloatSchema;
+  using commons::device_messages::internal::DeviceMessageHeaderSchema;
 
-  auto payload_size = std::min<std::size_t>(value.size(), 1500);
-  microloop::Buffer buf{sizeof(POD_DeviceMessage_Header) + payload_size};
-  auto data = static_cast<std::uint8_t *>(buf.data());
+  return DeviceMessageHeaderSchema::size + DeviceMessageFloatSchema::size;
+}
 
-  POD_DeviceMessage_Header *hdr = reinterpret_cast<POD_DeviceMessage_Header *>(data);
-  std::memcpy(hdr->topic, topic.c_str(), std::min(topic.size(), topic_maxlen()));
-  hdr->payload_type = PayloadType::STRING;
+void DeviceMessage<PayloadType::FLOAT>::serialize_into(std::uint8_t *data) const
+{
+  using commons::device_messages::internal::DeviceMessageFloatSchema;
+  using commons::device_messages::internal::DeviceMessageHeaderSchema;
+
+  auto payload = data + DeviceMessageHeaderSchema::size;
 
-  std::memcpy(data + sizeof(*hdr), value.c_str(), payload_size);
+  DeviceMessageHeaderSchema::encode(data, serialized_size(), topic, PayloadType::FLOAT);
+  DeviceMessageFloatSchema::encode(payload, DeviceMessageFloatSchema::size, sign, abs_val,
+      float_size);
+}
+
+microloop::Buffer DeviceMessage<PayloadType::STRING>::serialize() const
+{
+  auto buf = net_utils::BufferPool::local().acquire(serialized_size());
+  serialize_into(static_cast<std::uint8_t *>(buf.data()));
 
   return buf;
 }
 
+std::size_t DeviceMessage<PayloadType::STRING>::serialized_size() const
+{
+  using commons::device_messages::internal::DeviceMessageHeaderSchema;
+  using commons::subscriber_messages::internal::msg_payload_size;
+
+  return DeviceMessageHeaderSchema::size + std::min(value.size(), msg_payload_size());
+}
+
+void DeviceMessage<PayloadType::STRING>::serialize_into(std::uint8_t *data) const
+{
+  using commons::device_messages::internal::DeviceMessageHeaderSchema;
+  using commons::subscriber_messages::internal::msg_payload_size;
+
+  auto payload_size = std::min(value.size(), msg_payload_size());
+
+  DeviceMessageHeaderSchema::encode(data, serialized_size(), topic, PayloadType::STRING);
+  std::memcpy(data + DeviceMessageHeaderSchema::size, value.data(), payload_size);
+}
+
 }  // namespace commons::device_messages
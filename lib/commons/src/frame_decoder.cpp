@@ -0,0 +1,51 @@
+#include "commons/frame_decoder.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace commons::subscriber_messages
+{
+
+std::size_t FrameDecoder::fill_partial(const std::uint8_t *bytes, std::size_t n)
+{
+  std::size_t taken = 0;
+
+  /* The header is taken a byte at a time, as its size depends on the protocol version. */
+  while (partial_frame_size_ == 0 && taken != n)
+  {
+    partial_[partial_size_++] = bytes[taken++];
+
+    auto size = frame_size(partial_.data(), partial_size_, version_);
+    if (!size)
+    {
+      continue;
+    }
+
+    if (*size == 0)
+    {
+      malformed_ = true;
+      return taken;
+    }
+
+    partial_frame_size_ = *size;
+
+    /* The buffer only ever grows, up to the largest message seen. */
+    if (partial_.size() < partial_frame_size_)
+    {
+      partial_.resize(partial_frame_size_);
+    }
+  }
+
+  if (partial_frame_size_ == 0)
+  {
+    return taken;
+  }
+
+  auto rest = std::min(n - taken, partial_frame_size_ - partial_size_);
+  std::memcpy(partial_.data() + partial_size_, bytes + taken, rest);
+  partial_size_ += rest;
+
+  return taken + rest;
+}
+
+}  // namespace commons::subscriber_messages
@@ -1,17 +1,159 @@
 #pragma once
 
+#include "commons/subscriber_messages.h"
 #include "net_utils/receive_from.h"
 
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <utility>
 
 namespace commons::internal
 {
 
 static constexpr std::size_t topic_maxlen()
 {
-  return 50;
+  return device_messages::TOPIC_MAXLEN;
 }
 
+/*
+ * Compile-time schemas of the fixed-size layouts exchanged on the wire. A schema lists the fields
+ * of a layout in their wire order, and generates its encoder and decoder, which only check the size
+ * of the buffer once, or not at all when the buffer is an array of known size.
+ */
+
+/* Unsigned integer field, in network byte order. */
+template <class T>
+struct UintField
+{
+  using value_type = T;
+
+  static constexpr std::size_t size = sizeof(T);
+
+  static void write(std::uint8_t *dest, T value)
+  {
+    for (std::size_t i = size; i-- > 0; value >>= 8)
+    {
+      dest[i] = static_cast<std::uint8_t>(value);
+    }
+  }
+
+  static void read(const std::uint8_t *src, T &value)
+  {
+    value = 0;
+    for (std::size_t i = 0; i < size; i++)
+    {
+      value = static_cast<T>(value << 8 | src[i]);
+    }
+  }
+};
+
+/* String field of exactly \p N bytes, padded with null bytes, and not null-terminated when full. */
+template <std::size_t N>
+struct StrField
+{
+  using value_type = std::string_view;
+
+  static constexpr std::size_t size = N;
+
+  static void write(std::uint8_t *dest, std::string_view value)
+  {
+    auto len = std::min(value.size(), N);
+
+    std::memcpy(dest, value.data(), len);
+    std::memset(dest + len, 0, N - len);
+  }
+
+  static void read(const std::uint8_t *src, std::string_view &value)
+  {
+    auto str = reinterpret_cast<const char *>(src);
+    value = std::string_view{str, strnlen(str, N)};
+  }
+};
+
+template <class... Fields>
+struct Schema
+{
+  /* The size of the layout, in bytes. */
+  static constexpr std::size_t size = (Fields::size + ... + 0);
+
+  /**
+   * \brief Write the fields, given in the order of the schema, to \p dest.
+   * \returns The number of bytes written, or zero if \p n is less than the size of the layout.
+   */
+  static std::size_t encode(void *dest, std::size_t n, typename Fields::value_type... values)
+  {
+    if (n < size)
+    {
+      return 0;
+    }
+
+    write_fields(static_cast<std::uint8_t *>(dest), std::index_sequence_for<Fields...>{}, values...);
+    return size;
+  }
+
+  /* Same as above, for a buffer whose size is checked at compile time. */
+  template <std::size_t N>
+  static std::size_t encode(std::uint8_t (&dest)[N], typename Fields::value_type... values)
+  {
+    static_assert(N >= size, "The buffer cannot hold the layout");
+    return encode(dest, N, values...);
+  }
+
+  /**
+   * \brief Read the fields of the layout at \p src, in the order of the schema. Strings view the
+   * bytes at \p src.
+   * \returns Whether \p n is at least the size of the layout. Otherwise, nothing is read.
+   */
+  static bool decode(const void *src, std::size_t n, typename Fields::value_type &...values)
+  {
+    if (n < size)
+    {
+      return false;
+    }
+
+    read_fields(static_cast<const std::uint8_t *>(src), std::index_sequence_for<Fields...>{},
+        values...);
+    return true;
+  }
+
+private:
+  /* The offset of the field at index \p I in the layout, in bytes. */
+  template <std::size_t I>
+  static constexpr std::size_t offset()
+  {
+    constexpr std::size_t sizes[] = {Fields::size..., 0};
+
+    std::size_t pos = 0;
+    for (std::size_t i = 0; i < I; i++)
+    {
+      pos += sizes[i];
+    }
+
+    return pos;
+  }
+
+  /* Each field is written at its offset. A schema without fields writes nothing at \p dest. */
+  template <std::size_t... I>
+  static void write_fields([[maybe_unused]] std::uint8_t *dest,
+      std::index_sequence<I...>,
+      typename Fields::value_type... values)
+  {
+    (Fields::write(dest + offset<I>(), values), ...);
+  }
+
+  /* Each field is read from its offset. */
+  template <std::size_t... I>
+  static void read_fields([[maybe_unused]] const std::uint8_t *src,
+      std::index_sequence<I...>,
+      typename Fields::value_type &...values)
+  {
+    (Fields::read(src + offset<I>(), values), ...);
+  }
+};
+
 }  // namespace commons::internal
 
 
@@ -22,7 +164,7 @@ using namespace commons::internal;
 
 static constexpr std::size_t client_id_maxlen()
 {
-  return 10;
+  return CLIENT_ID_MAXLEN;
 }
 
 static constexpr std::size_t msg_payload_size()
@@ -32,7 +174,7 @@ static constexpr std::size_t msg_payload_size()
 
 static constexpr std::size_t notes_maxlen()
 {
-  return 64;
+  return NOTES_MAXLEN;
 }
 
 struct MsgHdr
@@ -41,33 +183,187 @@ struct MsgHdr
   std::uint16_t msg_size;
 } __attribute__((packed));
 
+using MsgHdrSchema = Schema<UintField<std::uint8_t>, UintField<std::uint16_t>>;
+static_assert(MsgHdrSchema::size == sizeof(MsgHdr));
+
+/**
+ * \brief Write a message of the given type, whose payload has the fixed-size layout \p Payload.
+ * \returns The number of bytes written, or zero if \p n is less than the size of the message.
+ */
+template <class Payload, class... Values>
+std::size_t encode_msg(void *dest, std::size_t n, MessageType type, const Values &...values)
+{
+  if (n < MsgHdrSchema::size + Payload::size)
+  {
+    return 0;
+  }
+
+  auto data = static_cast<std::uint8_t *>(dest);
+  MsgHdrSchema::encode(data, n, type, Payload::size);
+  Payload::encode(data + MsgHdrSchema::size, n - MsgHdrSchema::size, values...);
+
+  return MsgHdrSchema::size + Payload::size;
+}
+
+/* Greetings of clients supporting later protocol versions are followed by the version byte. */
 struct POD_GreetingMessage
 {
   char client_id[client_id_maxlen()];
 };
 
+using GreetingSchema = Schema<StrField<client_id_maxlen()>>;
+static_assert(GreetingSchema::size == sizeof(POD_GreetingMessage));
+
+using GreetingVersionSchema = Schema<StrField<client_id_maxlen()>, UintField<std::uint8_t>>;
+
+/* Flags of a subscribe request. Older subscribers only send the Store&Forward flag. */
+enum SubscribeFlags : std::uint8_t
+{
+  SUBSCRIBE_STORE_FORWARD = 1 << 0,
+  SUBSCRIBE_CONFLATE = 1 << 1,
+};
+
 struct POD_SubscribeRequest
 {
   char topic[topic_maxlen()];
-  bool store_forward : 8;
+  std::uint8_t flags;
 } __attribute__((__packed__));
 
+using SubscribeSchema = Schema<StrField<topic_maxlen()>, UintField<std::uint8_t>>;
+static_assert(SubscribeSchema::size == sizeof(POD_SubscribeRequest));
+
 struct POD_UnsubscribeRequest
 {
   char topic[topic_maxlen()];
 };
 
+using UnsubscribeSchema = Schema<StrField<topic_maxlen()>>;
+static_assert(UnsubscribeSchema::size == sizeof(POD_UnsubscribeRequest));
+
 struct POD_ServerResponse
 {
   std::uint8_t code;
   char notes[notes_maxlen()];
 };
 
+using ServerResponseSchema = Schema<UintField<std::uint8_t>, StrField<notes_maxlen()>>;
+static_assert(ServerResponseSchema::size == sizeof(POD_ServerResponse));
+
 struct POD_DeviceNotification_Hdr
 {
   char device_address[net_utils::AddressWrapper::str_maxlen];
 };
 
+using DeviceNotificationHdrSchema = Schema<StrField<net_utils::AddressWrapper::str_maxlen>>;
+static_assert(DeviceNotificationHdrSchema::size == sizeof(POD_DeviceNotification_Hdr));
+
+/*
+ * Bulk requests start with the number of topics they carry. BULK_SUBSCRIBE follows with a bitmap of
+ * the Store&Forward flags, then both requests list the topics, each prefixed by its length. Bulk
+ * subscribe requests with conflating subscriptions end with a bitmap of the conflate flags.
+ */
+struct POD_BulkRequest_Hdr
+{
+  std::uint16_t count;
+} __attribute__((__packed__));
+
+using BulkRequestHdrSchema = Schema<UintField<std::uint16_t>>;
+static_assert(BulkRequestHdrSchema::size == sizeof(POD_BulkRequest_Hdr));
+
+/* Followed by a bitmap of the results. */
+struct POD_BulkResponse_Hdr
+{
+  std::uint8_t request;
+  std::uint16_t count;
+} __attribute__((__packed__));
+
+using BulkResponseHdrSchema = Schema<UintField<std::uint8_t>, UintField<std::uint16_t>>;
+static_assert(BulkResponseHdrSchema::size == sizeof(POD_BulkResponse_Hdr));
+
+static constexpr std::size_t bitmap_size(std::size_t bits)
+{
+  return (bits + 7) / 8;
+}
+
+/*
+ * Protocol version 2 encodes sizes as variable-length integers: 7 bits per byte, least significant
+ * bits first, with the high bit set on every byte but the last. Sizes never exceed 16 bits.
+ */
+static constexpr std::size_t varint_maxlen()
+{
+  return 3;
+}
+
+inline std::size_t varint_size(std::uint32_t value)
+{
+  std::size_t size = 1;
+  for (; value >= 0x80; value >>= 7)
+  {
+    size++;
+  }
+
+  return size;
+}
+
+/* \returns The position right past the encoded value. */
+inline std::uint8_t *write_varint(std::uint8_t *dest, std::uint32_t value)
+{
+  for (; value >= 0x80; value >>= 7)
+  {
+    *dest++ = (value & 0x7f) | 0x80;
+  }
+
+  *dest++ = value;
+  return dest;
+}
+
+/**
+ * \brief Decode a variable-length integer from [pos, end).
+ * \returns The number of bytes the value takes, zero if the value does not end before \p end, or
+ * -1 if the value is too long.
+ */
+inline int read_varint(const std::uint8_t *pos, const std::uint8_t *end, std::uint32_t &value)
+{
+  value = 0;
+  for (std::size_t i = 0; i < varint_maxlen(); i++)
+  {
+    if (pos + i == end)
+    {
+      return 0;
+    }
+
+    value |= static_cast<std::uint32_t>(pos[i] & 0x7f) << (7 * i);
+    if (!(pos[i] & 0x80))
+    {
+      return value <= 0xffff ? i + 1 : -1;
+    }
+  }
+
+  return -1;
+}
+
+/* Size in bytes of the binary device address of protocol version 2 notifications. */
+static constexpr std::size_t address_bin_size()
+{
+  return net_utils::AddressWrapper::bin_size;
+}
+
+/* Parse the payload of a bulk response, of \p size bytes, which is the same for every version. */
+BulkResponse parse_bulk_response(const std::uint8_t *msg, std::size_t size);
+
+/*
+ * Protocol version 2 codecs, backing the versioned functions of the public interface. Version 3
+ * only adds messages on top of version 2, so the same codecs handle both.
+ */
+std::optional<std::size_t> frame_size_v2(const std::uint8_t *data,
+    std::size_t n,
+    std::uint8_t version);
+std::pair<SubscriberMessage, std::size_t> from_buffer_v2(const std::uint8_t *data,
+    std::size_t n,
+    std::uint8_t version,
+    const TopicTable *topics);
+microloop::Buffer serialize_v2(const ServerResponse &response);
+
 }  // namespace commons::subscriber_messages::internal
 
 
@@ -82,17 +378,26 @@ struct POD_DeviceMessage_Header
   std::uint8_t payload_type;
 } __attribute__((__packed__));
 
+using DeviceMessageHeaderSchema = Schema<StrField<topic_maxlen()>, UintField<std::uint8_t>>;
+static_assert(DeviceMessageHeaderSchema::size == sizeof(POD_DeviceMessage_Header));
+
 struct POD_DeviceMessage_Int
 {
   std::uint8_t sign;
   std::uint32_t value;
 } __attribute__((__packed__));
 
+using DeviceMessageIntSchema = Schema<UintField<std::uint8_t>, UintField<std::uint32_t>>;
+static_assert(DeviceMessageIntSchema::size == sizeof(POD_DeviceMessage_Int));
+
 struct POD_DeviceMessage_ShortReal
 {
   std::uint16_t value;
 } __attribute__((__packed__));
 
+using DeviceMessageShortRealSchema = Schema<UintField<std::uint16_t>>;
+static_assert(DeviceMessageShortRealSchema::size == sizeof(POD_DeviceMessage_ShortReal));
+
 struct POD_DeviceMessage_Float
 {
   std::uint8_t sign;
@@ -100,4 +405,8 @@ struct POD_DeviceMessage_Float
   std::uint8_t float_size;
 } __attribute__((__packed__));
 
+using DeviceMessageFloatSchema =
+    Schema<UintField<std::uint8_t>, UintField<std::uint32_t>, UintField<std::uint8_t>>;
+static_assert(DeviceMessageFloatSchema::size == sizeof(POD_DeviceMessage_Float));
+
 }  // namespace commons::device_messages::internal
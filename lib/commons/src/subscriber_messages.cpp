@@ -2,14 +2,198 @@
 
 #include "commons/device_messages.h"
 #include "messages_internal.h"
+#include "net_utils/buffer_pool.h"
 #include "net_utils/receive_from.h"
 
 #include <algorithm>
 #include <cstring>
+#include <stdexcept>
+#include <utility>
 
 namespace commons::subscriber_messages
 {
 
+namespace internal
+{
+
+BulkResponse parse_bulk_response(const std::uint8_t *msg, std::size_t size)
+{
+  std::uint8_t request;
+  std::uint16_t count;
+  if (!BulkResponseHdrSchema::decode(msg, size, request, count) ||
+      BulkResponseHdrSchema::size + bitmap_size(count) > size)
+  {
+    throw std::runtime_error{"malformed subscriber message"};
+  }
+
+  auto bitmap = msg + BulkResponseHdrSchema::size;
+
+  BulkResponse response{static_cast<MessageType>(request), {}};
+  response.results.resize(count);
+
+  for (std::size_t i = 0; i < response.results.size(); i++)
+  {
+    response.results[i] = bitmap[i / 8] & (1 << (i % 8));
+  }
+
+  return response;
+}
+
+}  // namespace internal
+
+namespace
+{
+
+/**
+ * \brief Parse the payload of a bulk subscribe or unsubscribe request, of \p size bytes.
+ * \throws std::runtime_error If the payload is not consistent with its size.
+ */
+SubscriberMessage parse_bulk_request(std::uint8_t type, const std::uint8_t *msg, std::size_t size)
+{
+  using internal::bitmap_size;
+  using internal::BulkRequestHdrSchema;
+  using internal::topic_maxlen;
+
+  auto end = msg + size;
+  auto malformed = [] { return std::runtime_error{"malformed subscriber message"}; };
+
+  std::uint16_t count;
+  if (!BulkRequestHdrSchema::decode(msg, size, count) || count > BULK_MAX_TOPICS)
+  {
+    throw malformed();
+  }
+
+  auto pos = msg + BulkRequestHdrSchema::size;
+
+  const std::uint8_t *flags = nullptr;
+  if (type == MessageType::BULK_SUBSCRIBE)
+  {
+    if (static_cast<std::size_t>(end - pos) < bitmap_size(count))
+    {
+      throw malformed();
+    }
+
+    flags = pos;
+    pos += bitmap_size(count);
+  }
+
+  std::vector<Topic> topics;
+  topics.reserve(count);
+
+  for (std::size_t i = 0; i < count; i++)
+  {
+    if (pos == end || *pos > topic_maxlen() || end - pos - 1 < *pos)
+    {
+      throw malformed();
+    }
+
+    topics.emplace_back(std::string_view{reinterpret_cast<const char *>(pos + 1), *pos});
+    pos += 1 + *pos;
+  }
+
+  if (type == MessageType::BULK_UNSUBSCRIBE)
+  {
+    if (pos != end)
+    {
+      throw malformed();
+    }
+
+    return BulkUnsubscribeRequest{std::move(topics)};
+  }
+
+  const std::uint8_t *conflate = nullptr;
+  if (pos != end)
+  {
+    if (static_cast<std::size_t>(end - pos) != bitmap_size(count))
+    {
+      throw malformed();
+    }
+
+    conflate = pos;
+  }
+
+  BulkSubscribeRequest request;
+  request.subscriptions.reserve(count);
+
+  for (std::size_t i = 0; i < count; i++)
+  {
+    std::uint8_t bit = 1 << (i % 8);
+
+    SubscribeRequest subscription{std::move(topics[i]), (flags[i / 8] & bit) != 0};
+    subscription.conflate = conflate && (conflate[i / 8] & bit);
+
+    request.subscriptions.push_back(std::move(subscription));
+  }
+
+  return request;
+}
+
+/**
+ * \brief Write the topics of a bulk request at \p dest, each prefixed by its length.
+ * \returns The position right past the last topic.
+ */
+template <class Func>
+std::uint8_t *write_topics(std::uint8_t *dest, std::size_t count, Func &&topic_at)
+{
+  using internal::topic_maxlen;
+
+  for (std::size_t i = 0; i < count; i++)
+  {
+    std::string_view topic = topic_at(i);
+    auto len = std::min(topic.size(), topic_maxlen());
+
+    *dest = len;
+    std::memcpy(dest + 1, topic.data(), len);
+    dest += 1 + len;
+  }
+
+  return dest;
+}
+
+/* Size of a version 1 notification carrying a device message of \p dev_msg_size bytes. */
+std::size_t notification_size(std::size_t dev_msg_size)
+{
+  return internal::MsgHdrSchema::size + internal::DeviceNotificationHdrSchema::size + dev_msg_size;
+}
+
+/**
+ * \brief Write the headers of a version 1 notification to \p buf, which holds
+ * `notification_size(dev_msg_size)` bytes.
+ * \returns The position of the device message, to be written by the caller.
+ */
+std::uint8_t *write_notification_hdr(microloop::Buffer &buf,
+    std::string_view device_address,
+    std::size_t dev_msg_size)
+{
+  using internal::DeviceNotificationHdrSchema;
+  using internal::MsgHdrSchema;
+
+  auto data = static_cast<std::uint8_t *>(buf.data());
+  auto msg_size = DeviceNotificationHdrSchema::size + dev_msg_size;
+
+  MsgHdrSchema::encode(data, buf.size(), MessageType::DEVICE_MSG, msg_size);
+  DeviceNotificationHdrSchema::encode(data + MsgHdrSchema::size, msg_size, device_address);
+
+  return data + MsgHdrSchema::size + DeviceNotificationHdrSchema::size;
+}
+
+/* Size of the topics of a bulk request, written by `write_topics`. */
+template <class Func>
+std::size_t topics_size(std::size_t count, Func &&topic_at)
+{
+  using internal::topic_maxlen;
+
+  std::size_t size = 0;
+  for (std::size_t i = 0; i < count; i++)
+  {
+    size += 1 + std::min(topic_at(i).size(), topic_maxlen());
+  }
+
+  return size;
+}
+
+}  // namespace
+
 bool is_valid_message_type(uint8_t value)
 {
   return value < MessageType::_COUNT;
@@ -17,180 +201,449 @@ bool is_valid_message_type(uint8_t value)
 
 bool can_parse_entire_msg(const microloop::Buffer &buf)
 {
-  using internal::MsgHdr;
+  using internal::MsgHdrSchema;
 
-  if (buf.size() < sizeof(MsgHdr))
+  std::uint8_t type;
+  std::uint16_t msg_size;
+  if (!MsgHdrSchema::decode(buf.data(), buf.size(), type, msg_size))
   {
     return false;
   }
 
-  auto hdr = (MsgHdr *)buf.data();
-  if (buf.size() - sizeof(MsgHdr) < ntohs(hdr->msg_size))
+  return buf.size() - MsgHdrSchema::size >= msg_size;
+}
+
+std::size_t frame_size(const void *hdr)
+{
+  using internal::DeviceNotificationHdrSchema;
+  using internal::GreetingSchema;
+  using internal::GreetingVersionSchema;
+  using internal::MsgHdrSchema;
+  using internal::ServerResponseSchema;
+  using internal::SubscribeSchema;
+  using internal::UnsubscribeSchema;
+
+  static_assert(MsgHdrSchema::size == FRAME_HEADER_SIZE);
+
+  std::uint8_t type;
+  std::uint16_t msg_size;
+  MsgHdrSchema::decode(hdr, FRAME_HEADER_SIZE, type, msg_size);
+
+  bool valid_size;
+  switch (type)
   {
-    return false;
+  case MessageType::GREETING:
+    valid_size = msg_size == GreetingSchema::size || msg_size == GreetingVersionSchema::size;
+    break;
+  case MessageType::SUBSCRIBE:
+    valid_size = msg_size == SubscribeSchema::size;
+    break;
+  case MessageType::UNSUBSCRIBE:
+    valid_size = msg_size == UnsubscribeSchema::size;
+    break;
+  case MessageType::RESPONSE:
+    valid_size = msg_size == ServerResponseSchema::size;
+    break;
+  case MessageType::DEVICE_MSG:
+    valid_size = msg_size > DeviceNotificationHdrSchema::size;
+    break;
+  case MessageType::BULK_SUBSCRIBE:
+  case MessageType::BULK_UNSUBSCRIBE:
+    valid_size = msg_size >= internal::BulkRequestHdrSchema::size;
+    break;
+  case MessageType::BULK_RESPONSE:
+    valid_size = msg_size >= internal::BulkResponseHdrSchema::size;
+    break;
+  case MessageType::SNAPSHOT:
+    valid_size = msg_size == 0;
+    break;
+  default:
+    valid_size = false;
   }
 
-  return true;
+  return valid_size ? MsgHdrSchema::size + msg_size : 0;
+}
+
+std::optional<std::size_t> frame_size(const void *data, std::size_t n, std::uint8_t version)
+{
+  if (version != PROTOCOL_V1)
+  {
+    return internal::frame_size_v2(static_cast<const std::uint8_t *>(data), n, version);
+  }
+
+  if (n < FRAME_HEADER_SIZE)
+  {
+    return std::nullopt;
+  }
+
+  return frame_size(data);
 }
 
 std::pair<SubscriberMessage, std::size_t> from_buffer(const microloop::Buffer &buf)
 {
-  using internal::MsgHdr;
-  using internal::POD_DeviceNotification_Hdr;
-  using internal::POD_GreetingMessage;
-  using internal::POD_ServerResponse;
-  using internal::POD_SubscribeRequest;
-  using internal::POD_UnsubscribeRequest;
+  return from_buffer(buf.data(), buf.size());
+}
 
-  auto data = static_cast<const std::uint8_t *>(buf.data());
-  auto hdr = (MsgHdr *)data;
-  auto msg = data + sizeof(MsgHdr);
+std::pair<SubscriberMessage, std::size_t> from_buffer(const void *data,
+    std::size_t n,
+    std::uint8_t version,
+    const TopicTable *topics)
+{
+  if (version != PROTOCOL_V1)
+  {
+    return internal::from_buffer_v2(static_cast<const std::uint8_t *>(data), n, version, topics);
+  }
 
-  auto consumed = sizeof(MsgHdr) + ntohs(hdr->msg_size);
+  return from_buffer(data, n);
+}
 
-  switch (hdr->type)
+std::pair<SubscriberMessage, std::size_t> from_buffer(const void *buf, std::size_t n)
+{
+  using internal::DeviceNotificationHdrSchema;
+  using internal::GreetingSchema;
+  using internal::GreetingVersionSchema;
+  using internal::MsgHdrSchema;
+  using internal::ServerResponseSchema;
+  using internal::SubscribeSchema;
+  using internal::UnsubscribeSchema;
+
+  auto malformed = [] { return std::runtime_error{"malformed subscriber message"}; };
+
+  std::uint8_t type;
+  std::uint16_t msg_size;
+  if (!MsgHdrSchema::decode(buf, n, type, msg_size) || frame_size(buf) == 0 ||
+      n < frame_size(buf))
   {
-  case MessageType::GREETING: {
-    auto pod = (const POD_GreetingMessage *)msg;
+    throw malformed();
+  }
 
-    char client_id[sizeof(pod->client_id) + 1]{};
-    memcpy(client_id, pod->client_id, sizeof(pod->client_id));
+  auto msg = static_cast<const std::uint8_t *>(buf) + MsgHdrSchema::size;
+  auto consumed = MsgHdrSchema::size + msg_size;
 
-    return {GreetingMessage{std::string{client_id}}, consumed};
+  /* The sizes of the fixed layouts are checked by frame_size, and again by their decoders. */
+  switch (type)
+  {
+  case MessageType::GREETING: {
+    std::string_view client_id;
+    GreetingMessage greeting;
+
+    if (msg_size == GreetingVersionSchema::size)
+    {
+      GreetingVersionSchema::decode(msg, msg_size, client_id, greeting.version);
+    }
+    else if (!GreetingSchema::decode(msg, msg_size, client_id))
+    {
+      throw malformed();
+    }
+
+    greeting.client_id = client_id;
+    return {std::move(greeting), consumed};
   }
   case MessageType::SUBSCRIBE: {
-    auto pod = (const POD_SubscribeRequest *)msg;
-    return {SubscribeRequest{std::string{pod->topic}, pod->store_forward}, consumed};
+    using internal::SUBSCRIBE_CONFLATE;
+    using internal::SUBSCRIBE_STORE_FORWARD;
+
+    std::string_view topic;
+    std::uint8_t flags;
+    if (!SubscribeSchema::decode(msg, msg_size, topic, flags))
+    {
+      throw malformed();
+    }
+
+    SubscribeRequest request{topic, (flags & SUBSCRIBE_STORE_FORWARD) != 0,
+        (flags & SUBSCRIBE_CONFLATE) != 0};
+    return {std::move(request), consumed};
   }
   case MessageType::UNSUBSCRIBE: {
-    auto pod = (const POD_UnsubscribeRequest *)msg;
-    return {UnsubscribeRequest{std::string{pod->topic}}, consumed};
+    std::string_view topic;
+    if (!UnsubscribeSchema::decode(msg, msg_size, topic))
+    {
+      throw malformed();
+    }
+
+    return {UnsubscribeRequest{topic}, consumed};
   }
   case MessageType::RESPONSE: {
     using commons::server_response::StatusCode;
 
-    auto pod = (const POD_ServerResponse *)msg;
-    return {ServerResponse{static_cast<StatusCode>(pod->code), std::string{pod->notes}}, consumed};
+    std::uint8_t code;
+    std::string_view notes;
+    if (!ServerResponseSchema::decode(msg, msg_size, code, notes))
+    {
+      throw malformed();
+    }
+
+    return {ServerResponse{static_cast<StatusCode>(code), notes}, consumed};
   }
   case MessageType::DEVICE_MSG: {
-    auto notif_hdr = (const POD_DeviceNotification_Hdr *)msg;
-    auto notif_msg = msg + sizeof(POD_DeviceNotification_Hdr);
-    auto notif_len = ntohs(hdr->msg_size) - sizeof(POD_DeviceNotification_Hdr);
+    std::string_view address;
+    if (!DeviceNotificationHdrSchema::decode(msg, msg_size, address))
+    {
+      throw malformed();
+    }
+
+    auto notif_msg = msg + DeviceNotificationHdrSchema::size;
+    auto notif_len = msg_size - DeviceNotificationHdrSchema::size;
     auto device_msg = device_messages::from_buffer(notif_msg, notif_len);
-    return {DeviceNotification{std::string{notif_hdr->device_address}, device_msg}, consumed};
+    return {DeviceNotification{std::string{address}, device_msg}, consumed};
   }
+  case MessageType::BULK_SUBSCRIBE:
+  case MessageType::BULK_UNSUBSCRIBE:
+    return {parse_bulk_request(type, msg, msg_size), consumed};
+  case MessageType::BULK_RESPONSE:
+    return {internal::parse_bulk_response(msg, msg_size), consumed};
+  case MessageType::SNAPSHOT:
+    return {SnapshotRequest{}, consumed};
   default:
     __builtin_unreachable();
 
-    /* Undefined behavior. The caller must perform the checks. */
+    /* Checked by frame_size. */
   }
 }
 
 microloop::Buffer GreetingMessage::serialize() const
 {
-  using internal::client_id_maxlen;
-  using internal::MsgHdr;
-  using internal::POD_GreetingMessage;
+  auto buf = net_utils::BufferPool::local().acquire(serialized_size());
+  serialize_into(buf.data(), buf.size());
 
-  microloop::Buffer buf{sizeof(MsgHdr) + sizeof(POD_GreetingMessage)};
-  std::uint8_t *data = static_cast<std::uint8_t *>(buf.data());
+  return buf;
+}
 
-  auto hdr = (MsgHdr *)data;
-  auto payload = (POD_GreetingMessage *)(data + sizeof(MsgHdr));
+std::size_t GreetingMessage::serialized_size() const
+{
+  using internal::GreetingSchema;
+  using internal::GreetingVersionSchema;
+  using internal::MsgHdrSchema;
 
-  hdr->type = MessageType::GREETING;
-  hdr->msg_size = htons(sizeof(POD_GreetingMessage));
+  /* Version 1 greetings are sent exactly as they used to be, without the version byte. */
+  return MsgHdrSchema::size +
+      (version != PROTOCOL_V1 ? GreetingVersionSchema::size : GreetingSchema::size);
+}
 
-  memcpy(payload->client_id, client_id.c_str(), std::min(client_id_maxlen(), client_id.size()));
+std::size_t GreetingMessage::serialize_into(void *dest, std::size_t n) const
+{
+  using internal::encode_msg;
+  using internal::GreetingSchema;
+  using internal::GreetingVersionSchema;
 
-  return buf;
+  if (version != PROTOCOL_V1)
+  {
+    return encode_msg<GreetingVersionSchema>(dest, n, MessageType::GREETING, client_id, version);
+  }
+
+  return encode_msg<GreetingSchema>(dest, n, MessageType::GREETING, client_id);
 }
 
 microloop::Buffer SubscribeRequest::serialize() const
 {
-  using commons::internal::topic_maxlen;
-  using internal::client_id_maxlen;
-  using internal::MsgHdr;
-  using internal::POD_SubscribeRequest;
+  auto buf = net_utils::BufferPool::local().acquire(serialized_size());
+  serialize_into(buf.data(), buf.size());
 
-  microloop::Buffer buf{sizeof(MsgHdr) + sizeof(POD_SubscribeRequest)};
-  std::uint8_t *data = static_cast<std::uint8_t *>(buf.data());
+  return buf;
+}
 
-  auto hdr = (MsgHdr *)data;
-  auto payload = (POD_SubscribeRequest *)(data + sizeof(MsgHdr));
+std::size_t SubscribeRequest::serialized_size() const
+{
+  return internal::MsgHdrSchema::size + internal::SubscribeSchema::size;
+}
 
-  hdr->type = MessageType::SUBSCRIBE;
-  hdr->msg_size = htons(sizeof(POD_SubscribeRequest));
+std::size_t SubscribeRequest::serialize_into(void *dest, std::size_t n) const
+{
+  using internal::encode_msg;
+  using internal::SubscribeSchema;
 
-  memcpy(payload->topic, topic.c_str(), std::min(sizeof(payload->topic), topic.size()));
-  payload->store_forward = store_forward;
+  std::uint8_t flags = (store_forward ? internal::SUBSCRIBE_STORE_FORWARD : 0) |
+      (conflate ? internal::SUBSCRIBE_CONFLATE : 0);
 
-  return buf;
+  return encode_msg<SubscribeSchema>(dest, n, MessageType::SUBSCRIBE, topic, flags);
 }
 
 microloop::Buffer UnsubscribeRequest::serialize() const
 {
-  using commons::internal::topic_maxlen;
-  using internal::client_id_maxlen;
-  using internal::MsgHdr;
-  using internal::POD_UnsubscribeRequest;
+  auto buf = net_utils::BufferPool::local().acquire(serialized_size());
+  serialize_into(buf.data(), buf.size());
+
+  return buf;
+}
+
+std::size_t UnsubscribeRequest::serialized_size() const
+{
+  return internal::MsgHdrSchema::size + internal::UnsubscribeSchema::size;
+}
+
+std::size_t UnsubscribeRequest::serialize_into(void *dest, std::size_t n) const
+{
+  using internal::encode_msg;
+  using internal::UnsubscribeSchema;
+
+  return encode_msg<UnsubscribeSchema>(dest, n, MessageType::UNSUBSCRIBE, topic);
+}
+
+microloop::Buffer ServerResponse::serialize(std::uint8_t version) const
+{
+  if (version != PROTOCOL_V1)
+  {
+    return internal::serialize_v2(*this);
+  }
+
+  auto buf = net_utils::BufferPool::local().acquire(serialized_size());
+  serialize_into(buf.data(), buf.size());
+
+  return buf;
+}
 
-  microloop::Buffer buf{sizeof(MessageType) + sizeof(POD_UnsubscribeRequest)};
+std::size_t ServerResponse::serialized_size() const
+{
+  return internal::MsgHdrSchema::size + internal::ServerResponseSchema::size;
+}
+
+std::size_t ServerResponse::serialize_into(void *dest, std::size_t n) const
+{
+  using internal::encode_msg;
+  using internal::ServerResponseSchema;
+
+  return encode_msg<ServerResponseSchema>(dest, n, MessageType::RESPONSE,
+      static_cast<std::uint8_t>(code), notes);
+}
+
+microloop::Buffer DeviceNotification::serialize(std::uint8_t version) const
+{
+  if (version != PROTOCOL_V1)
+  {
+    auto frame = serialize(PROTOCOL_V1);
+    return transcode(frame.data(), frame.size(), version);
+  }
+
+  auto dev_msg_size =
+      std::visit([](auto &&arg) { return arg.serialized_size(); }, original_message);
+
+  auto buf = net_utils::BufferPool::local().acquire(notification_size(dev_msg_size));
+  auto notif_payload = write_notification_hdr(buf, device_address, dev_msg_size);
+  std::visit([&](auto &&arg) { arg.serialize_into(notif_payload); }, original_message);
+
+  return buf;
+}
+
+microloop::Buffer DeviceNotification::serialize(std::string_view device_address,
+    const device_messages::DeviceMessageView &msg)
+{
+  auto dev_msg_size = msg.serialized_size();
+
+  auto buf = net_utils::BufferPool::local().acquire(notification_size(dev_msg_size));
+  auto notif_payload = write_notification_hdr(buf, device_address, dev_msg_size);
+  msg.serialize_into(notif_payload);
+
+  return buf;
+}
+
+microloop::Buffer BulkSubscribeRequest::serialize() const
+{
+  using internal::bitmap_size;
+  using internal::BulkRequestHdrSchema;
+  using internal::MsgHdrSchema;
+
+  auto count = std::min(subscriptions.size(), BULK_MAX_TOPICS);
+  auto topic_at = [&](std::size_t i) -> const Topic & { return subscriptions[i].topic; };
+  auto msg_size = BulkRequestHdrSchema::size + bitmap_size(count) + topics_size(count, topic_at);
+
+  /* The conflate flags are left out if none is set, so older Gateways accept the request. */
+  auto conflating = std::any_of(subscriptions.begin(), subscriptions.begin() + count,
+      [](auto &&subscription) { return subscription.conflate; });
+  if (conflating)
+  {
+    msg_size += bitmap_size(count);
+  }
+
+  auto buf = net_utils::BufferPool::local().acquire(MsgHdrSchema::size + msg_size);
   std::uint8_t *data = static_cast<std::uint8_t *>(buf.data());
+  auto payload = data + MsgHdrSchema::size;
+  auto flags = payload + BulkRequestHdrSchema::size;
 
-  auto hdr = (MsgHdr *)data;
-  auto payload = (POD_UnsubscribeRequest *)(data + sizeof(MsgHdr));
+  MsgHdrSchema::encode(data, buf.size(), MessageType::BULK_SUBSCRIBE, msg_size);
+  BulkRequestHdrSchema::encode(payload, msg_size, count);
 
-  hdr->type = MessageType::UNSUBSCRIBE;
-  hdr->msg_size = htons(sizeof(POD_UnsubscribeRequest));
+  for (std::size_t i = 0; i < count; i++)
+  {
+    flags[i / 8] |= subscriptions[i].store_forward << (i % 8);
+  }
 
-  memcpy(payload->topic, topic.c_str(), std::min(sizeof(payload->topic), topic.size()));
+  auto conflate = write_topics(flags + bitmap_size(count), count, topic_at);
+
+  for (std::size_t i = 0; conflating && i < count; i++)
+  {
+    conflate[i / 8] |= subscriptions[i].conflate << (i % 8);
+  }
 
   return buf;
 }
 
-microloop::Buffer ServerResponse::serialize() const
+microloop::Buffer BulkUnsubscribeRequest::serialize() const
 {
-  using commons::subscriber_messages::internal::notes_maxlen;
-  using internal::MsgHdr;
-  using internal::POD_ServerResponse;
+  using internal::BulkRequestHdrSchema;
+  using internal::MsgHdrSchema;
 
-  microloop::Buffer buf{sizeof(MsgHdr) + sizeof(POD_ServerResponse)};
+  auto count = std::min(topics.size(), BULK_MAX_TOPICS);
+  auto topic_at = [&](std::size_t i) -> const Topic & { return topics[i]; };
+  auto msg_size = BulkRequestHdrSchema::size + topics_size(count, topic_at);
+
+  auto buf = net_utils::BufferPool::local().acquire(MsgHdrSchema::size + msg_size);
   std::uint8_t *data = static_cast<std::uint8_t *>(buf.data());
+  auto payload = data + MsgHdrSchema::size;
+
+  MsgHdrSchema::encode(data, buf.size(), MessageType::BULK_UNSUBSCRIBE, msg_size);
+  BulkRequestHdrSchema::encode(payload, msg_size, count);
 
-  auto hdr = (MsgHdr *)data;
-  auto payload = (POD_ServerResponse *)(data + sizeof(MsgHdr));
+  write_topics(payload + BulkRequestHdrSchema::size, count, topic_at);
 
-  hdr->type = MessageType::RESPONSE;
-  hdr->msg_size = htons(sizeof(POD_ServerResponse));
+  return buf;
+}
+
+microloop::Buffer SnapshotRequest::serialize() const
+{
+  using internal::encode_msg;
+  using internal::Schema;
 
-  payload->code = code;
-  std::memcpy(payload->notes, notes.c_str(), std::min(notes.size(), notes_maxlen()));
+  auto buf = net_utils::BufferPool::local().acquire(internal::MsgHdrSchema::size);
+  encode_msg<Schema<>>(buf.data(), buf.size(), MessageType::SNAPSHOT);
 
   return buf;
 }
 
-microloop::Buffer DeviceNotification::serialize() const
+microloop::Buffer BulkResponse::serialize(std::uint8_t version) const
 {
-  using internal::MsgHdr;
-  using internal::POD_DeviceNotification_Hdr;
+  using internal::bitmap_size;
+  using internal::BulkResponseHdrSchema;
+  using internal::MsgHdrSchema;
+  using internal::varint_size;
+  using internal::write_varint;
+
+  auto count = std::min(results.size(), BULK_MAX_TOPICS);
+  auto msg_size = BulkResponseHdrSchema::size + bitmap_size(count);
 
-  microloop::Buffer raw_dev_msg;
-  std::visit([&](auto &&arg) { raw_dev_msg = arg.serialize(); }, original_message);
+  /* The payload is the same for both versions, only the size in the header is encoded apart. */
+  auto hdr_size = version == PROTOCOL_V1 ? MsgHdrSchema::size : 1 + varint_size(msg_size);
 
-  microloop::Buffer buf{sizeof(MsgHdr) + sizeof(POD_DeviceNotification_Hdr) + raw_dev_msg.size()};
+  auto buf = net_utils::BufferPool::local().acquire(hdr_size + msg_size);
   std::uint8_t *data = static_cast<std::uint8_t *>(buf.data());
+  auto payload = data + hdr_size;
+  auto bitmap = payload + BulkResponseHdrSchema::size;
 
-  auto hdr = (MsgHdr *)data;
-  auto notif_hdr = (POD_DeviceNotification_Hdr *)(data + sizeof(MsgHdr));
-  auto notif_payload = data + sizeof(MsgHdr) + sizeof(POD_DeviceNotification_Hdr);
+  if (version == PROTOCOL_V1)
+  {
+    MsgHdrSchema::encode(data, hdr_size, MessageType::BULK_RESPONSE, msg_size);
+  }
+  else
+  {
+    data[0] = MessageType::BULK_RESPONSE;
+    write_varint(data + 1, msg_size);
+  }
 
-  hdr->type = MessageType::DEVICE_MSG;
-  hdr->msg_size = htons(sizeof(POD_DeviceNotification_Hdr) + raw_dev_msg.size());
+  BulkResponseHdrSchema::encode(payload, msg_size, request, count);
 
-  std::memcpy(notif_hdr->device_address, device_address.c_str(),
-      std::min(net_utils::AddressWrapper::str_maxlen, device_address.size()));
-  std::memcpy(notif_payload, raw_dev_msg.data(), raw_dev_msg.size());
+  for (std::size_t i = 0; i < count; i++)
+  {
+    bitmap[i / 8] |= results[i] << (i % 8);
+  }
 
   return buf;
 }
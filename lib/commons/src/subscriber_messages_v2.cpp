@@ -0,0 +1,348 @@
+#include "commons/subscriber_messages.h"
+
+#include "commons/device_messages.h"
+#include "messages_internal.h"
+#include "net_utils/address_wrapper.h"
+#include "net_utils/buffer_pool.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+/*
+ * Protocol version 2 encodes the messages sent by the Gateway without any padding. Every message
+ * starts with its type, followed by the payload size as a variable-length integer:
+ *
+ *   RESPONSE:       code (1), notes size (varint), notes
+ *   DEVICE_MSG:     device address (18, binary), topic size (varint), topic, payload type (1),
+ *                   payload, which spans up to the end of the message
+ *   BULK_RESPONSE:  same payload as version 1
+ *
+ * Protocol version 3 adds a per-connection topic dictionary, so notifications do not repeat their
+ * topic over and over:
+ *
+ *   TOPIC_DEFINITION:   topic identifier (varint), topic, which spans up to the end of the message
+ *   TAGGED_DEVICE_MSG:  device address (18, binary), topic identifier (varint), payload type (1),
+ *                       payload, which spans up to the end of the message
+ *
+ * Version 3 connections may still get DEVICE_MSG notifications, e.g. for topics without identifier.
+ */
+
+namespace commons::subscriber_messages
+{
+
+namespace
+{
+
+std::runtime_error malformed()
+{
+  return std::runtime_error{"malformed subscriber message"};
+}
+
+/**
+ * \brief Allocate a version 2 message with room for a payload of \p msg_size bytes.
+ * \returns The buffer, along with the position where the payload starts.
+ */
+std::pair<microloop::Buffer, std::uint8_t *> make_message(MessageType type, std::size_t msg_size)
+{
+  using internal::varint_size;
+  using internal::write_varint;
+
+  auto buf = net_utils::BufferPool::local().acquire(1 + varint_size(msg_size) + msg_size);
+  std::uint8_t *data = static_cast<std::uint8_t *>(buf.data());
+
+  data[0] = type;
+  auto payload = write_varint(data + 1, msg_size);
+
+  return {std::move(buf), payload};
+}
+
+}  // namespace
+
+namespace internal
+{
+
+std::optional<std::size_t> frame_size_v2(const std::uint8_t *data,
+    std::size_t n,
+    std::uint8_t version)
+{
+  if (n == 0)
+  {
+    return std::nullopt;
+  }
+
+  std::uint32_t msg_size;
+  int len = read_varint(data + 1, data + n, msg_size);
+  if (len == 0)
+  {
+    return std::nullopt;
+  }
+
+  bool valid_size;
+  switch (data[0])
+  {
+  case MessageType::RESPONSE:
+    valid_size = msg_size >= 2;
+    break;
+  case MessageType::DEVICE_MSG:
+    valid_size = msg_size >= address_bin_size() + 2;
+    break;
+  case MessageType::BULK_RESPONSE:
+    valid_size = msg_size >= sizeof(POD_BulkResponse_Hdr);
+    break;
+  case MessageType::TOPIC_DEFINITION:
+    valid_size = version >= PROTOCOL_V3 && msg_size >= 2;
+    break;
+  case MessageType::TAGGED_DEVICE_MSG:
+    valid_size = version >= PROTOCOL_V3 && msg_size >= address_bin_size() + 2;
+    break;
+  default:
+    /* Only the messages sent by the Gateway have a version 2 encoding. */
+    valid_size = false;
+  }
+
+  return len > 0 && valid_size ? 1 + len + msg_size : 0;
+}
+
+std::pair<SubscriberMessage, std::size_t> from_buffer_v2(const std::uint8_t *data,
+    std::size_t n,
+    std::uint8_t version,
+    const TopicTable *topics)
+{
+  auto size = frame_size_v2(data, n, version);
+  if (!size || *size == 0 || n < *size)
+  {
+    throw malformed();
+  }
+
+  std::uint32_t msg_size;
+  auto msg = data + 1 + read_varint(data + 1, data + n, msg_size);
+  auto end = msg + msg_size;
+
+  /* Read a string prefixed by its size, of no more than \p maxlen bytes. */
+  auto read_str = [&](const std::uint8_t *&pos, std::size_t maxlen) {
+    std::uint32_t len;
+    int varint_len = read_varint(pos, end, len);
+    if (varint_len <= 0 || len > maxlen || end - pos - varint_len < len)
+    {
+      throw malformed();
+    }
+
+    std::string_view str{reinterpret_cast<const char *>(pos + varint_len), len};
+    pos += varint_len + len;
+
+    return str;
+  };
+
+  auto read_topic_id = [&](const std::uint8_t *&pos) {
+    std::uint32_t id;
+    int varint_len = read_varint(pos, end, id);
+    if (varint_len <= 0)
+    {
+      throw malformed();
+    }
+
+    pos += varint_len;
+    return id;
+  };
+
+  /* Build a notification from the remaining bytes of the message, past the topic. */
+  auto make_notification = [&](const std::uint8_t *pos, std::string_view topic) {
+    if (pos == end)
+    {
+      throw malformed();
+    }
+
+    std::string_view payload{reinterpret_cast<const char *>(pos + 1),
+        static_cast<std::size_t>(end - pos - 1)};
+
+    auto view = device_messages::DeviceMessageView::from_parts(topic, *pos, payload);
+    if (!view)
+    {
+      throw malformed();
+    }
+
+    auto address = net_utils::AddressWrapper::from_binary(msg).str();
+    return DeviceNotification{std::move(address), view->materialize()};
+  };
+
+  switch (data[0])
+  {
+  case MessageType::RESPONSE: {
+    using commons::server_response::StatusCode;
+
+    auto pos = msg + 1;
+    auto notes = read_str(pos, notes_maxlen());
+    if (pos != end)
+    {
+      throw malformed();
+    }
+
+    return {ServerResponse{static_cast<StatusCode>(msg[0]), notes}, *size};
+  }
+  case MessageType::DEVICE_MSG: {
+    auto pos = msg + address_bin_size();
+    auto topic = read_str(pos, topic_maxlen());
+
+    return {make_notification(pos, topic), *size};
+  }
+  case MessageType::TOPIC_DEFINITION: {
+    auto pos = msg;
+    auto id = read_topic_id(pos);
+    if (pos == end || static_cast<std::size_t>(end - pos) > topic_maxlen())
+    {
+      throw malformed();
+    }
+
+    std::string_view topic{reinterpret_cast<const char *>(pos),
+        static_cast<std::size_t>(end - pos)};
+    return {TopicDefinition{id, topic}, *size};
+  }
+  case MessageType::TAGGED_DEVICE_MSG: {
+    auto pos = msg + address_bin_size();
+    auto id = read_topic_id(pos);
+
+    /* Notifications may only refer to topics defined earlier on the connection. */
+    auto topic = topics ? topics->find(id) : TopicTable::const_iterator{};
+    if (!topics || topic == topics->end())
+    {
+      throw malformed();
+    }
+
+    return {make_notification(pos, topic->second), *size};
+  }
+  case MessageType::BULK_RESPONSE:
+    return {parse_bulk_response(msg, msg_size), *size};
+  default:
+    __builtin_unreachable();
+
+    /* Checked by frame_size_v2. */
+  }
+}
+
+microloop::Buffer serialize_v2(const ServerResponse &response)
+{
+  auto notes_len = std::min(response.notes.size(), notes_maxlen());
+  auto msg_size = 1 + varint_size(notes_len) + notes_len;
+
+  auto [buf, payload] = make_message(MessageType::RESPONSE, msg_size);
+
+  payload[0] = response.code;
+  auto notes = write_varint(payload + 1, notes_len);
+  std::memcpy(notes, response.notes.data(), notes_len);
+
+  return std::move(buf);
+}
+
+}  // namespace internal
+
+microloop::Buffer DeviceNotification::serialize_v2(const std::uint8_t *device_address,
+    const device_messages::DeviceMessageView &msg)
+{
+  using internal::address_bin_size;
+  using internal::varint_size;
+  using internal::write_varint;
+
+  auto topic = msg.topic();
+  auto payload = msg.payload();
+
+  auto msg_size =
+      address_bin_size() + varint_size(topic.size()) + topic.size() + 1 + payload.size();
+
+  auto [buf, pos] = make_message(MessageType::DEVICE_MSG, msg_size);
+
+  std::memcpy(pos, device_address, address_bin_size());
+  pos = write_varint(pos + address_bin_size(), topic.size());
+  std::memcpy(pos, topic.data(), topic.size());
+  pos += topic.size();
+  *pos++ = msg.type();
+  std::memcpy(pos, payload.data(), payload.size());
+
+  return std::move(buf);
+}
+
+microloop::Buffer DeviceNotification::serialize_tagged(const std::uint8_t *device_address,
+    std::uint32_t topic_id,
+    const device_messages::DeviceMessageView &msg)
+{
+  using internal::address_bin_size;
+  using internal::varint_size;
+  using internal::write_varint;
+
+  auto payload = msg.payload();
+  auto msg_size = address_bin_size() + varint_size(topic_id) + 1 + payload.size();
+
+  auto [buf, pos] = make_message(MessageType::TAGGED_DEVICE_MSG, msg_size);
+
+  std::memcpy(pos, device_address, address_bin_size());
+  pos = write_varint(pos + address_bin_size(), topic_id);
+  *pos++ = msg.type();
+  std::memcpy(pos, payload.data(), payload.size());
+
+  return std::move(buf);
+}
+
+microloop::Buffer TopicDefinition::serialize() const
+{
+  using internal::topic_maxlen;
+  using internal::varint_size;
+  using internal::write_varint;
+
+  auto topic_len = std::min(topic.size(), topic_maxlen());
+
+  auto [buf, pos] = make_message(MessageType::TOPIC_DEFINITION, varint_size(id) + topic_len);
+
+  pos = write_varint(pos, id);
+  std::memcpy(pos, topic.data(), topic_len);
+
+  return std::move(buf);
+}
+
+microloop::Buffer DeviceNotification::transcode(const void *frame,
+    std::size_t n,
+    std::uint8_t version)
+{
+  using internal::address_bin_size;
+  using internal::DeviceNotificationHdrSchema;
+  using internal::MsgHdrSchema;
+
+  auto data = static_cast<const std::uint8_t *>(frame);
+  if (n < MsgHdrSchema::size || data[0] != MessageType::DEVICE_MSG || frame_size(data) != n)
+  {
+    throw malformed();
+  }
+
+  if (version == PROTOCOL_V1)
+  {
+    auto buf = net_utils::BufferPool::local().acquire(n);
+    std::memcpy(buf.data(), frame, n);
+
+    return buf;
+  }
+
+  auto msg = data + MsgHdrSchema::size;
+  auto msg_size = n - MsgHdrSchema::size;
+
+  std::string_view address;
+  if (!DeviceNotificationHdrSchema::decode(msg, msg_size, address))
+  {
+    throw malformed();
+  }
+
+  auto notif_msg = msg + DeviceNotificationHdrSchema::size;
+  auto view = device_messages::DeviceMessageView::parse(notif_msg, data + n - notif_msg);
+  if (!view)
+  {
+    throw malformed();
+  }
+
+  /* An address that cannot be converted is sent as the unspecified address. */
+  std::uint8_t address_bin[address_bin_size()]{};
+  net_utils::AddressWrapper::str_to_binary(address, address_bin);
+
+  return serialize_v2(address_bin, *view);
+}
+
+}  // namespace commons::subscriber_messages
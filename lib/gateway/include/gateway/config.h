@@ -0,0 +1,99 @@
+#pragma once
+
+#include "net_utils/receive_from.h"
+
+#include <cstdint>
+#include <string>
+
+namespace gateway
+{
+
+/**
+ * \brief What happens to the notifications of a subscriber whose outbound queue went past its high
+ * watermark, until the queue drains below its low watermark.
+ */
+enum class OverflowPolicy
+{
+  /* The oldest queued notifications are dropped to make room for the new ones. */
+  DROP_OLDEST,
+
+  /* Only the latest notification of every topic is kept, and sent once the queue drains. */
+  CONFLATE,
+
+  /* Notifications are kept by the Store&Forward storage, and sent once the queue drains. */
+  SPILL,
+
+  /* The subscriber is disconnected, keeping its Store&Forward subscriptions. */
+  DISCONNECT,
+};
+
+/**
+ * \brief Tunables of the Gateway. The defaults are suitable for small deployments.
+ */
+struct Config
+{
+  /* Maximum number of datagrams drained from the input endpoint socket per wakeup. */
+  std::size_t udp_batch_size = net_utils::ReceiveFrom::DEFAULT_BATCH_SIZE;
+
+  /*
+   * Number of threads receiving and parsing device datagrams, each on its own SO_REUSEPORT socket.
+   * Zero means datagrams are received on the event loop thread.
+   */
+  std::size_t udp_shards = 0;
+
+  /*
+   * Maximum number of messages received by an ingest thread and waiting to be routed by the event
+   * loop thread. The messages received past it are dropped.
+   */
+  std::size_t udp_handoff = 16384;
+
+  /*
+   * Number of reactor threads writing to subscriber connections. Every connection is owned by one
+   * reactor. Zero means writing on the event loop thread.
+   */
+  std::size_t tcp_reactors = 0;
+
+  /*
+   * Size at which the notifications waiting for a subscriber are written at once, in bytes. Zero
+   * disables coalescing, so every notification is written on its own.
+   */
+  std::size_t coalesce_bytes = 16384;
+
+  /*
+   * How long notifications may wait to be coalesced, in microseconds. Zero means they are written
+   * at the end of the event loop tick they were sent in.
+   */
+  std::size_t coalesce_us = 0;
+
+  /*
+   * Watermarks of the outbound queue of every subscriber, in bytes. Past the high watermark, the
+   * overflow policy applies until the queue drains below the low watermark. With reactors, the
+   * bytes handed to a reactor count as queued until it wrote them, and only up to the low
+   * watermark of them is handed over at a time.
+   */
+  std::size_t queue_high = 1 << 20;
+  std::size_t queue_low = 1 << 18;
+
+  OverflowPolicy overflow = OverflowPolicy::DROP_OLDEST;
+
+  /*
+   * Memory available to the latest message of every topic, sent to subscribers upon subscription,
+   * in bytes. The cache needs every message, so it keeps the input endpoint from discarding the
+   * datagrams whose topic has no subscribers before parsing them. Zero disables the cache.
+   */
+  std::size_t last_value_bytes = 0;
+
+  /* Maximum number of device sources whose formatted address and counters are kept. */
+  std::size_t device_sources = 4096;
+
+  /*
+   * Directory of the memory-mapped Store&Forward log. When empty, Store&Forward messages are only
+   * kept in memory and are lost upon restart.
+   */
+  std::string sf_dir;
+
+  /* Interval between group commits of the Store&Forward log, in milliseconds. */
+  std::size_t sf_commit_ms = 10;
+};
+
+}  // namespace gateway
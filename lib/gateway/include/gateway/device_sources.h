@@ -0,0 +1,107 @@
+#pragma once
+
+#include "net_utils/address_wrapper.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace gateway
+{
+
+/**
+ * \brief Bounded table of the devices sending datagrams to the Gateway.
+ *
+ * Sources are identified by their raw socket address, so repeated datagrams from a known device do
+ * not need to format its address again. When the table is full, a source that has not been seen
+ * recently is evicted, following the CLOCK policy.
+ */
+class DeviceSources
+{
+public:
+  struct Source
+  {
+    /* The address formatted as obtained from AddressWrapper::str(). */
+    char address[net_utils::AddressWrapper::str_maxlen];
+    std::size_t address_len;
+
+    /* The address in binary form, as obtained from AddressWrapper::to_binary(). */
+    std::uint8_t address_bin[net_utils::AddressWrapper::bin_size];
+
+    /* Datagrams and bytes received from this source while it was in the table. */
+    std::uint64_t datagrams;
+    std::uint64_t bytes;
+
+    std::string_view address_str() const
+    {
+      return {address, address_len};
+    }
+  };
+
+  explicit DeviceSources(std::size_t capacity);
+
+  /**
+   * \brief Retrieve the entry of the given source, creating it if the source is not known.
+   */
+  Source &lookup(const net_utils::AddressWrapper &source);
+
+  std::size_t size() const
+  {
+    return index_.size();
+  }
+
+  /* The number of sources evicted to make room for new ones. */
+  std::uint64_t evictions() const
+  {
+    return evictions_;
+  }
+
+  template <class Func>
+  void for_each(Func &&func) const
+  {
+    for (auto &[_, slot] : index_)
+    {
+      func(slots_[slot].source);
+    }
+  }
+
+private:
+  /* The binary form of the address, as obtained from AddressWrapper::to_binary(). */
+  struct Key
+  {
+    std::uint8_t bytes[net_utils::AddressWrapper::bin_size];
+
+    bool operator==(const Key &other) const
+    {
+      return std::memcmp(bytes, other.bytes, sizeof(bytes)) == 0;
+    }
+  };
+
+  struct KeyHash
+  {
+    std::size_t operator()(const Key &key) const;
+  };
+
+  struct Slot
+  {
+    Key key;
+    bool referenced;
+    Source source;
+  };
+
+  static Key make_key(const net_utils::AddressWrapper &source);
+
+  /* Find a slot to be reused, evicting its source. */
+  std::uint32_t evict();
+
+private:
+  std::size_t capacity_;
+  std::vector<Slot> slots_;
+  std::unordered_map<Key, std::uint32_t, KeyHash> index_;
+  std::size_t clock_hand_ = 0;
+  std::uint64_t evictions_ = 0;
+};
+
+}  // namespace gateway
@@ -0,0 +1,297 @@
+#pragma once
+
+#include "gateway/config.h"
+#include "gateway/spsc_ring.h"
+#include "gateway/subscriber_conn.h"
+#include "microloop/net/tcp_server.h"
+#include "net_utils/notifier.h"
+#include "net_utils/timer.h"
+#include "net_utils/writable_watcher.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace gateway
+{
+
+/**
+ * \brief Outbound path of the subscriber endpoint.
+ *
+ * By default, frames are written to their connection on the calling thread, without ever blocking.
+ * Every connection has an outbound queue, holding the frames its socket did not accept yet, which
+ * is drained as soon as the socket becomes writable again. Once a queue goes past its high
+ * watermark, the connection is reported as congested until the queue drains below its low
+ * watermark, and it is up to the caller to stop sending notifications meanwhile.
+ *
+ * When reactors are enabled, every connection is owned by one of N reactor threads, chosen by its
+ * file descriptor, and all the writes to that connection are performed by its reactor. Frames are
+ * passed to the reactors through lock-free queues, so all the frames sent to a connection are
+ * written in the order they were submitted. Reactors never block either: each of them keeps the
+ * frames its sockets did not accept yet, and writes them once the sockets become writable. Only up
+ * to the low watermark of bytes is handed to the reactor of a connection at a time, and reactors
+ * report the bytes they wrote back to the event loop thread. The rest waits in the outbound queue
+ * of the connection, so watermarks and overflow policies apply just the same. When the queue of a
+ * reactor is full, frames also wait in the outbound queue, and are submitted again as soon as the
+ * reactor makes room.
+ *
+ * When coalescing is enabled, frames are first gathered per connection, and every batch is written
+ * using a single system call. A batch is flushed as soon as it reaches the size threshold, and
+ * otherwise at the end of the current event loop tick, or once the flush delay expires if one is
+ * configured. Under light load, batches hold a single frame and add no latency, while bursts of
+ * notifications get packed into large writes.
+ *
+ * All the member functions are to be called from the event loop thread.
+ */
+class Egress
+{
+public:
+  /* Counters of a connection. */
+  struct Stats
+  {
+    /* The frames written to the connection. */
+    std::uint64_t frames = 0;
+
+    /* The system calls these frames were written with, telling the batching factor achieved. */
+    std::uint64_t writes = 0;
+
+    /* The frames dropped from the outbound queue. */
+    std::uint64_t dropped = 0;
+
+    /* The times frames had to wait in the outbound queue, for the queue of the reactor was full. */
+    std::uint64_t stalls = 0;
+
+    /* The largest size the outbound queue reached, in bytes. */
+    std::size_t high_water = 0;
+  };
+
+  /**
+   * \brief Callback invoked once the outbound queue of a congested connection drains below its low
+   * watermark, or once the socket of a blocked connection accepted the whole queue, taking the file
+   * descriptor of the connection.
+   */
+  using DrainedCallback = std::function<void(std::uint32_t fd)>;
+
+  explicit Egress(const Config &config);
+
+  Egress(const Egress &) = delete;
+  Egress &operator=(const Egress &) = delete;
+
+  ~Egress();
+
+  /**
+   * \brief Send a frame to a connection.
+   * \param droppable Whether the frame may be dropped from the outbound queue by drop_oldest().
+   * Frames other notifications depend upon, such as topic definitions, must not be dropped.
+   * \returns Whether the frame was sent, or queued. Frames are only refused by broken connections.
+   */
+  bool send(microloop::net::TcpServer::PeerConnection &conn,
+      SharedFrame frame,
+      bool droppable = false);
+
+  /**
+   * \brief Flush the frames pending for \p conn, without waiting for them to be written. Frames
+   * that cannot be written or submitted to a reactor right away are left in the outbound queue.
+   */
+  void quiesce(const microloop::net::TcpServer::PeerConnection &conn);
+
+  /**
+   * \brief Drop the outbound queue and counters of a connection, once it is being closed. With
+   * reactors, the frames already submitted are written as far as the socket accepts them at once,
+   * using a descriptor of the reactor, so the connection may be closed right away.
+   */
+  void detach(const microloop::net::TcpServer::PeerConnection &conn);
+
+  /**
+   * \brief To be called at the end of every event loop tick, so no frame is delayed past the tick
+   * it was sent in, unless a flush delay is configured.
+   */
+  void on_tick_end();
+
+  /* Whether the outbound queue of \p conn went past its high watermark and did not drain yet. */
+  bool congested(const microloop::net::TcpServer::PeerConnection &conn) const;
+
+  /**
+   * \brief Whether the socket of \p conn did not accept all the bytes written to it, so the queue
+   * waits for the socket to become writable again. With reactors, whether the queue waits for the
+   * reactor to write the bytes in flight.
+   */
+  bool blocked(const microloop::net::TcpServer::PeerConnection &conn) const;
+
+  /* Whether nothing is waiting to be written to \p conn. */
+  bool idle(const microloop::net::TcpServer::PeerConnection &conn) const;
+
+  /**
+   * \brief Drop the oldest droppable frames from the outbound queue of \p conn, until the queue is
+   * back under its low watermark.
+   */
+  void drop_oldest(const microloop::net::TcpServer::PeerConnection &conn);
+
+  void on_drained(DrainedCallback &&callback)
+  {
+    on_drained_ = std::move(callback);
+  }
+
+  /* Retrieve the counters of a connection. */
+  Stats stats(const microloop::net::TcpServer::PeerConnection &conn) const;
+
+private:
+  class Reactor;
+
+  struct Pending
+  {
+    SharedFrame frame;
+    bool droppable;
+  };
+
+  struct Connection
+  {
+    /* Frames not written yet. The first one may be written in part. */
+    std::deque<Pending> queue;
+
+    /* Bytes of the first frame written already. */
+    std::size_t offset = 0;
+
+    /* Bytes in the queue not written yet. */
+    std::size_t queued = 0;
+
+    /* Bytes handed to the reactor of the connection, not reported as written yet. */
+    std::size_t in_flight = 0;
+
+    /* Bytes queued since the last flush, when coalescing. */
+    std::size_t unflushed = 0;
+
+    /*
+     * Whether the socket did not accept any more bytes, so it is being watched for EPOLLOUT. With
+     * reactors, whether frames wait in the queue for the reactor to write those in flight.
+     */
+    bool blocked = false;
+
+    bool congested = false;
+
+    /*
+     * The descriptor of the socket used by the reactor of the connection, duplicated so it stays
+     * open until the reactor is done with it, even after the connection is closed.
+     */
+    int reactor_fd = -1;
+
+    /* Identifies the connection to its reactor, unlike descriptors, which get reused. */
+    std::uint64_t serial = 0;
+
+    /* Whether frames wait for room in the queue of the reactor. */
+    bool stalled = false;
+
+    Stats stats;
+  };
+
+  /* Result of writing an outbound queue without blocking. */
+  enum class WriteStatus
+  {
+    /* The whole queue was written. */
+    WRITTEN,
+
+    /* The socket did not accept the whole queue, so it has to become writable first. */
+    BLOCKED,
+
+    /* The connection is broken, so the queue is to be dropped. */
+    BROKEN,
+  };
+
+  /**
+   * \brief Write \p queue to the socket \p fd, as much as it accepts without blocking, popping the
+   * frames written entirely.
+   * \param offset The bytes of the first frame written already, updated with the part written of
+   * the new first frame.
+   * \param written Incremented by the number of bytes written.
+   * \param retired If given, gets the frames written entirely instead of them being released.
+   */
+  static WriteStatus write_queue(int fd,
+      std::deque<Pending> &queue,
+      std::size_t &offset,
+      Stats &stats,
+      std::size_t &written,
+      std::vector<SharedFrame> *retired = nullptr);
+
+  /* The reactor writing to the reactor descriptor \p reactor_fd of a connection. */
+  Reactor &owner(int reactor_fd);
+
+  /**
+   * \brief Submit the queue of a connection to its reactor, as far as the queue of the reactor and
+   * the bytes in flight allow. The frames left keep the connection blocked.
+   */
+  bool submit(std::uint32_t fd, Connection &c);
+
+  /**
+   * \brief Write the queue of a connection, as much as its socket accepts, or hand it to its
+   * reactor.
+   * \returns Whether the connection is not broken.
+   */
+  bool write(std::uint32_t fd, Connection &c);
+
+  /* Update the congestion state of a connection, after the size of its queue changed. */
+  void update(std::uint32_t fd, Connection &c);
+
+  /* Callback to be invoked when the socket of a blocked connection becomes writable. */
+  void on_writable(std::uint32_t fd);
+
+  /* Callback to be invoked once a reactor wrote bytes, or made room in its full queue. */
+  void on_reactor_progress();
+
+  /* Account the bytes a reactor wrote to the connection \p serial. */
+  void on_reactor_written(std::uint64_t serial, std::size_t bytes);
+
+  /* Submit the queue of a connection again, once its reactor made room or wrote bytes. */
+  void resubmit(std::uint32_t fd, Connection &c);
+
+  /* Invoke the drained callback for the connections that are no longer congested or blocked. */
+  void notify_drained();
+
+  /* Flush the frames of all the connections. */
+  void flush();
+
+private:
+  std::vector<std::unique_ptr<Reactor>> reactors_;
+
+  std::size_t coalesce_bytes_;
+  std::chrono::microseconds coalesce_delay_;
+  std::size_t queue_high_;
+  std::size_t queue_low_;
+
+  /* Outbound queues and counters of the connections, by file descriptor. */
+  std::unordered_map<std::uint32_t, Connection> conns_;
+
+  /* Connections with frames waiting to be flushed. */
+  std::vector<std::uint32_t> pending_;
+
+  /* Flushes the frames once the flush delay expires. Owned by the event loop. */
+  net_utils::Timer *flush_timer_ = nullptr;
+
+  /* Tells when blocked connections become writable. Owned by the event loop. */
+  net_utils::WritableWatcher *writable_ = nullptr;
+
+  /* Tells when reactors wrote bytes, or made room in their full queues. Owned by the event loop. */
+  net_utils::Notifier *reactor_progress_ = nullptr;
+
+  /* Connections handed to a reactor, by serial. */
+  std::unordered_map<std::uint64_t, std::uint32_t> serials_;
+  std::uint64_t next_serial_ = 0;
+
+  /* Connections waiting for room in the queue of their reactor. */
+  std::vector<std::uint32_t> stalled_;
+
+  /* Reactor descriptors of closed connections, waiting for room to be handed back to a reactor. */
+  std::vector<int> detaching_;
+
+  /* Connections that are no longer congested or blocked, to be told about outside of send(). */
+  std::vector<std::uint32_t> drained_;
+
+  DrainedCallback on_drained_;
+};
+
+}  // namespace gateway
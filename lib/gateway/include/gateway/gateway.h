@@ -2,19 +2,28 @@
 
 #include "commons/device_messages.h"
 #include "commons/subscriber_messages.h"
+#include "gateway/config.h"
+#include "gateway/device_sources.h"
+#include "gateway/egress.h"
 #include "gateway/input_endpoint.h"
+#include "gateway/last_value_cache.h"
+#include "gateway/store_forward.h"
 #include "gateway/subscriber_conn.h"
 #include "gateway/subscriber_endpoint.h"
+#include "gateway/topic_dictionary.h"
 #include "microloop/net/tcp_server.h"
 #include "net_utils/udp_server.h"
 
 #include <cstdint>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <utility>
 #include <variant>
+#include <vector>
 
 namespace gateway
 {
@@ -25,21 +34,59 @@ namespace gateway
 class Gateway
 {
 public:
-  Gateway(int port) : input_endpoint_{port}, subscriber_endpoint_{port, subscribers_}
-  {
-    /* Pipe device data input into the subscriber endpoint */
-    input_endpoint_.subscribe(&Gateway::on_device_input, this);
-  }
+  Gateway(int port, const Config &config = {});
 
   /* Event handler for device messages. */
   void on_device_input(const net_utils::AddressWrapper &,
-      const commons::device_messages::GenericDeviceMessage &);
+      const commons::device_messages::DeviceMessageView &);
+
+  /* To be called at the end of every event loop tick. */
+  void on_tick_end();
+
+  /* Print runtime counters, meant to help sizing the Gateway tunables. */
+  void print_stats(std::ostream &os) const;
+
+  /* Print the known device sources, along with their counters. */
+  void print_sources(std::ostream &os) const;
+
+private:
+  /* Create the Store&Forward storage selected by the configuration. */
+  static std::unique_ptr<StoreForward> make_store_forward(const Config &config);
+
+  /* Whether the notifications for \p client are to go through the overflow policy. */
+  bool diverted(const SubscriberConnection &client) const;
+
+  /**
+   * \brief Apply the overflow policy to a notification for a congested subscriber.
+   * \param frame The notification, using the version 1 encoding.
+   * \returns Whether the notification is still to be sent.
+   */
+  bool on_overflow(SubscriberConnection &client, std::string_view topic, const SharedFrame &frame);
+
+  /* Callback to be invoked once the outbound queue of a congested or blocked subscriber drains. */
+  void on_drained(std::uint32_t fd);
 
 private:
+  OverflowPolicy overflow_;
+
+  Egress egress_;
+  std::unique_ptr<StoreForward> store_forward_;
+  LastValueCache last_values_;
   endpoint::InputEndpoint input_endpoint_;
   endpoint::SubscriberEndpoint subscriber_endpoint_;
 
   SubscribersStorage subscribers_;
+  DeviceSources sources_;
+  TopicDictionary topic_ids_;
+
+  /* The subscribers of the message being routed, kept to reuse its memory. */
+  std::vector<const TopicSubscriber *> matched_;
+
+  /* The handle of the topic of the message being routed among the conflated topics, if known. */
+  InternTable::Handle conflated_topic_ = InternTable::NONE;
+
+  /* Subscribers to be disconnected by the overflow policy, once the current message is routed. */
+  std::vector<std::string> slow_clients_;
 };
 
 }  // namespace gateway
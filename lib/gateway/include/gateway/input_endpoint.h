@@ -1,32 +1,79 @@
 #pragma once
 
 #include "commons/device_messages.h"
+#include "gateway/topic_filter.h"
+#include "net_utils/datagram_batch.h"
+#include "net_utils/notifier.h"
 #include "net_utils/udp_server.h"
+#include "net_utils/udp_shards.h"
 
+#include <atomic>
 #include <cstdint>
 #include <functional>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <utility>
+#include <vector>
 
 namespace gateway::endpoint
 {
 
 /**
  * \brief Abstraction for the UDP endpoint exposed for clients to push messages into the system.
+ *
+ * Messages are parsed into views over the receive buffers, so no message data is copied unless a
+ * subscriber needs to keep it. Malformed datagrams are dropped. Given a topic filter, datagrams
+ * whose topic has no subscribers are discarded before being parsed, or copied out of a shard.
+ *
+ * By default, datagrams are received and parsed on the event loop thread. If sharding is enabled,
+ * several `SO_REUSEPORT` sockets are drained and validated by their own threads instead. The valid
+ * messages are then handed off to the event loop thread, where the subscriber callback is invoked.
+ * Each shard has a bounded hand-off queue, and the messages it receives while its queue is full are
+ * dropped, so a lagging event loop does not make memory grow.
  */
 class InputEndpoint
 {
 private:
   using MessageCallback = std::function<void(const net_utils::AddressWrapper &,
-      const commons::device_messages::GenericDeviceMessage &)>;
+      const commons::device_messages::DeviceMessageView &)>;
+
+  /* A validated datagram, copied out of the receive slab of a shard. */
+  using ReceivedMessage = std::pair<net_utils::AddressWrapper, microloop::Buffer>;
 
 public:
-  InputEndpoint(std::uint16_t port) : server_{port}
+  /**
+   * \param batch_size The maximum number of datagrams to be drained from a socket per wakeup.
+   * \param shards The number of ingest threads. Zero means receiving on the event loop thread.
+   * \param handoff_capacity The maximum number of messages of a shard waiting to be dispatched.
+   */
+  InputEndpoint(std::uint16_t port,
+      std::size_t batch_size,
+      std::size_t shards,
+      std::size_t handoff_capacity);
+
+  void on_batch(const net_utils::DatagramBatch &batch);
+
+  /**
+   * \brief Discard the datagrams whose topic is not in \p filter, or stop discarding datagrams
+   * given `nullptr`. The filter must outlive the endpoint.
+   */
+  void set_topic_filter(const TopicFilter *filter)
+  {
+    filter_.store(filter, std::memory_order_release);
+  }
+
+  /* The number of datagrams discarded for having no subscribers. */
+  std::uint64_t discarded() const
   {
-    server_.set_data_callback(&InputEndpoint::on_data, this);
+    return discarded_.load(std::memory_order_relaxed);
   }
 
-  void on_data(const net_utils::AddressWrapper &source, const microloop::Buffer &buf);
+  /* The number of messages dropped by the shards for finding their hand-off queue full. */
+  std::uint64_t handoff_dropped() const
+  {
+    return handoff_dropped_.load(std::memory_order_relaxed);
+  }
 
   template <class Func, class... Args>
   void subscribe(Func &&func, Args &&... args)
@@ -37,8 +84,55 @@ public:
   }
 
 private:
-  net_utils::UdpServer server_;
+  /* Whether a datagram may have subscribers, counting it as discarded otherwise. */
+  bool wanted(const net_utils::Datagram &datagram);
+
+  /* Validate a batch on a shard thread and hand the messages off to the event loop thread. */
+  void on_shard_batch(std::size_t shard, const net_utils::DatagramBatch &batch);
+
+  /* Dispatch the messages handed off by the shard threads. Runs on the event loop thread. */
+  void on_handoff();
+
+private:
+  /* The messages handed off by a shard thread, and the buffers it is given back. */
+  struct Handoff
+  {
+    std::mutex mutex;
+
+    /* Messages received by the shard thread, waiting to be dispatched on the event loop thread. */
+    std::vector<ReceivedMessage> queue;
+
+    /*
+     * Buffers of the dispatched messages, released by the shard thread into its own pool, which
+     * they were acquired from.
+     */
+    std::vector<microloop::Buffer> recycled;
+
+    /* Only used by the shard thread, and kept to reuse their memory. */
+    std::vector<ReceivedMessage> received;
+    std::vector<microloop::Buffer> reclaimed;
+  };
+
+private:
   MessageCallback subscriber_;
+
+  /* Checked by the shard threads as well, and swapped by the event loop thread. */
+  std::atomic<const TopicFilter *> filter_{nullptr};
+  std::atomic<std::uint64_t> discarded_{0};
+
+  std::unique_ptr<net_utils::UdpServer> server_;
+
+  /* One hand-off queue per shard, so the shards do not contend with each other. */
+  std::size_t handoff_capacity_;
+  std::vector<std::unique_ptr<Handoff>> handoffs_;
+  std::atomic<std::uint64_t> handoff_dropped_{0};
+  net_utils::Notifier *handoff_notifier_ = nullptr;  // Owned by the event loop.
+
+  /* The messages being dispatched by the event loop thread, kept to reuse their memory. */
+  std::vector<ReceivedMessage> dispatched_;
+
+  /* Declared last, so the shard threads are stopped before the hand-off queue is destroyed. */
+  std::unique_ptr<net_utils::UdpShards> shards_;
 };
 
 }  // namespace gateway::endpoint
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace gateway
+{
+
+/**
+ * \brief Table of interned strings, such as topics or client identifiers, each bound to a dense
+ * 32-bit handle for as long as it is referenced.
+ *
+ * Handles are small integers, so the data attached to strings can be kept in plain vectors indexed
+ * by handle, and compared or hashed as integers. A string is hashed once, when it enters the table
+ * or is looked up, and a handle is reused once its string is released by all its holders.
+ */
+class InternTable
+{
+public:
+  using Handle = std::uint32_t;
+
+  static constexpr Handle NONE = UINT32_MAX;
+
+  InternTable() = default;
+
+  InternTable(const InternTable &) = delete;
+  InternTable &operator=(const InternTable &) = delete;
+
+  /**
+   * \brief Take a reference to \p str, interning it if it is not in the table yet.
+   * \returns The handle of the string.
+   */
+  Handle acquire(std::string_view str)
+  {
+    if (auto it = handles_.find(str); it != handles_.end())
+    {
+      entries_[it->second].refs++;
+      return it->second;
+    }
+
+    Handle handle;
+    if (free_.empty())
+    {
+      handle = static_cast<Handle>(entries_.size());
+      entries_.emplace_back();
+    }
+    else
+    {
+      handle = free_.back();
+      free_.pop_back();
+    }
+
+    /* The key views the string owned by the entry, which never moves in memory. */
+    auto &entry = entries_[handle];
+    entry.str = str;
+    entry.refs = 1;
+
+    handles_.emplace(entry.str, handle);
+    return handle;
+  }
+
+  /* Take one more reference to the string of \p handle, which is in use. */
+  void retain(Handle handle)
+  {
+    entries_[handle].refs++;
+  }
+
+  /**
+   * \brief Drop a reference to the string of \p handle, taken by acquire() or retain().
+   * \returns Whether it was the last one, so the string has left the table and its handle is free.
+   */
+  bool release(Handle handle)
+  {
+    auto &entry = entries_[handle];
+    if (--entry.refs != 0)
+    {
+      return false;
+    }
+
+    handles_.erase(entry.str);
+    entry.str = std::string{};
+    free_.push_back(handle);
+
+    return true;
+  }
+
+  /**
+   * \brief Look \p str up without interning it.
+   * \returns The handle of the string, or NONE if it is not in the table.
+   */
+  Handle find(std::string_view str) const
+  {
+    auto it = handles_.find(str);
+    return it != handles_.end() ? it->second : NONE;
+  }
+
+  /* The string of a handle in use. */
+  std::string_view str(Handle handle) const
+  {
+    return entries_[handle].str;
+  }
+
+  /* The number of handles ever handed out, in use or free, which bounds all the handles. */
+  std::size_t capacity() const
+  {
+    return entries_.size();
+  }
+
+  /* The number of strings in the table. */
+  std::size_t size() const
+  {
+    return handles_.size();
+  }
+
+private:
+  struct Entry
+  {
+    std::string str;
+    std::uint32_t refs = 0;
+  };
+
+private:
+  /* A deque, so the strings viewed by the keys never move as entries are added. */
+  std::deque<Entry> entries_;
+  std::vector<Handle> free_;
+
+  std::unordered_map<std::string_view, Handle> handles_;
+};
+
+}  // namespace gateway
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "commons/device_messages.h"
+#include "gateway/device_sources.h"
+#include "microloop/buffer.h"
+#include "net_utils/address_wrapper.h"
+
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace gateway
+{
+
+/**
+ * \brief Bounded cache of the latest device message of every topic, sent to subscribers as soon as
+ * they subscribe, so they do not wait for devices to send again.
+ *
+ * Messages are kept in their serialized form, along with the address of their source in the forms
+ * cached by DeviceSources, and are only encoded as notifications when requested. Once the cache
+ * uses more memory than allowed, the topics updated least recently are evicted.
+ */
+class LastValueCache
+{
+public:
+  /**
+   * \param capacity The memory available to the cache, in bytes. Zero disables the cache.
+   */
+  explicit LastValueCache(std::size_t capacity) : capacity_{capacity}
+  {}
+
+  /* Keep \p msg, sent by \p source, as the latest message of its topic. */
+  void update(const DeviceSources::Source &source,
+      const commons::device_messages::DeviceMessageView &msg);
+
+  /**
+   * \brief Serialize the latest message of \p topic as a notification, using the given protocol
+   * version. Version 3 subscribers get the version 2 encoding, which carries the topic itself.
+   * \returns The notification, or an empty optional if no message of the topic is cached.
+   */
+  std::optional<microloop::Buffer> notification(std::string_view topic,
+      std::uint8_t version) const;
+
+  /* Invoke \p func with every cached topic. */
+  template <class Func>
+  void for_each_topic(Func &&func) const
+  {
+    for (auto &entry : entries_)
+    {
+      func(std::string_view{entry.topic});
+    }
+  }
+
+  std::size_t size() const
+  {
+    return index_.size();
+  }
+
+  /* The memory used by the cached messages, in bytes. */
+  std::size_t bytes() const
+  {
+    return bytes_;
+  }
+
+  /* The number of topics evicted to make room for others. */
+  std::uint64_t evictions() const
+  {
+    return evictions_;
+  }
+
+private:
+  struct Entry
+  {
+    std::string topic;
+
+    /* The address of the source, in the forms of DeviceSources::Source. */
+    char address[net_utils::AddressWrapper::str_maxlen];
+    std::size_t address_len;
+    std::uint8_t address_bin[net_utils::AddressWrapper::bin_size];
+
+    std::uint8_t type;
+    std::string payload;
+  };
+
+  /* The memory accounted for an entry. */
+  static std::size_t footprint(const Entry &entry)
+  {
+    return sizeof(Entry) + entry.topic.size() + entry.payload.capacity();
+  }
+
+private:
+  std::size_t capacity_;
+  std::size_t bytes_ = 0;
+  std::uint64_t evictions_ = 0;
+
+  /* The entries, updated most recently first. */
+  std::list<Entry> entries_;
+
+  /* The keys view the topics owned by the entries, which never move in memory. */
+  std::unordered_map<std::string_view, std::list<Entry>::iterator> index_;
+};
+
+}  // namespace gateway
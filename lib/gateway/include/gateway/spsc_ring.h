@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace gateway
+{
+
+/**
+ * \brief Bounded, lock-free queue for exactly one producer thread and one consumer thread.
+ */
+template <class T>
+class SpscRing
+{
+public:
+  /**
+   * \param capacity The maximum number of queued items. Rounded up to a power of two.
+   */
+  explicit SpscRing(std::size_t capacity)
+  {
+    std::size_t size = 1;
+    while (size < capacity)
+    {
+      size <<= 1;
+    }
+
+    slots_.resize(size);
+    mask_ = size - 1;
+  }
+
+  /**
+   * \brief Enqueue an item. To be called only from the producer thread.
+   * \return Whether the item was enqueued, i.e. the queue was not full.
+   */
+  bool try_push(T &&item)
+  {
+    auto head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == slots_.size())
+    {
+      return false;
+    }
+
+    slots_[head & mask_] = std::move(item);
+    head_.store(head + 1, std::memory_order_seq_cst);
+
+    return true;
+  }
+
+  /**
+   * \brief Dequeue an item. To be called only from the consumer thread.
+   * \return Whether an item was dequeued, i.e. the queue was not empty.
+   */
+  bool try_pop(T &item)
+  {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+
+    item = std::move(slots_[tail & mask_]);
+    tail_.store(tail + 1, std::memory_order_release);
+
+    return true;
+  }
+
+  bool empty() const
+  {
+    return tail_.load(std::memory_order_seq_cst) == head_.load(std::memory_order_seq_cst);
+  }
+
+  /**
+   * \brief Get the number of items ever enqueued.
+   */
+  std::uint64_t pushed() const
+  {
+    return head_.load(std::memory_order_acquire);
+  }
+
+private:
+  std::vector<T> slots_;
+  std::size_t mask_;
+
+  /* Kept on separate cache lines, as they are written by different threads. */
+  alignas(64) std::atomic<std::uint64_t> head_{0};
+  alignas(64) std::atomic<std::uint64_t> tail_{0};
+};
+
+}  // namespace gateway
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "gateway/egress.h"
+#include "gateway/subscriber_conn.h"
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace gateway
+{
+
+/**
+ * \brief Storage for the messages to be delivered to Store&Forward subscribers upon reconnection.
+ */
+class StoreForward
+{
+public:
+  virtual ~StoreForward() = default;
+
+  /**
+   * \brief Keep a notification frame, published on \p topic, to be delivered to the offline
+   * \p client. The same frame is appended once for every offline subscriber of the topic.
+   */
+  virtual void append(SubscriberConnection &client,
+      std::string_view topic,
+      const SharedFrame &frame) = 0;
+
+  /**
+   * \brief Deliver all the frames kept for \p client, which has just reconnected. Frames that
+   * could not be delivered are kept for the next reconnection.
+   */
+  virtual void replay(SubscriberConnection &client, Egress &egress) = 0;
+
+  /**
+   * \brief Make the frames appended so far durable, if the storage supports it.
+   */
+  virtual void commit()
+  {}
+};
+
+/**
+ * \brief Store&Forward storage keeping the frames in the memory of the Gateway. Frames are lost if
+ * the Gateway is restarted.
+ *
+ * Every topic has a single log of the frames published while some of its subscribers were offline,
+ * no matter how many of them there are. An offline subscriber only holds a cursor into the log of
+ * each of its topics, which is the sequence number of the first frame it has not received yet.
+ * Frames are trimmed from the front of a log as soon as the slowest cursor moves past them.
+ */
+class MemoryStoreForward : public StoreForward
+{
+public:
+  void append(SubscriberConnection &client,
+      std::string_view topic,
+      const SharedFrame &frame) override;
+
+  void replay(SubscriberConnection &client, Egress &egress) override;
+
+private:
+  struct Entry
+  {
+    /* Sequence number, increasing across all topics, so replays keep the publishing order. */
+    std::uint64_t seq;
+    SharedFrame frame;
+  };
+
+  struct TopicLog
+  {
+    std::string topic;
+    std::deque<Entry> entries;
+
+    /* Number of cursors pointing at each sequence number. The first one is the slowest. */
+    std::map<std::uint64_t, std::size_t> cursors;
+  };
+
+  /* Encode a stored frame, which uses the version 1 encoding, for the protocol of \p client. */
+  static SharedFrame encode_for(const SubscriberConnection &client, const SharedFrame &frame);
+
+  /**
+   * \brief Move a cursor of \p log from \p from to \p to, or drop it if \p to is empty. Frames
+   * behind the slowest cursor left are trimmed.
+   */
+  void move_cursor(TopicLog &log, std::uint64_t from, std::optional<std::uint64_t> to);
+
+private:
+  std::uint64_t next_seq_ = 0;
+
+  /* The key views the topic owned by the log, which never moves in memory. */
+  std::unordered_map<std::string_view, std::unique_ptr<TopicLog>> logs_;
+};
+
+}  // namespace gateway
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "gateway/store_forward.h"
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace gateway
+{
+
+/**
+ * \brief Store&Forward storage backed by append-only, memory-mapped segment files, which survive
+ * Gateway restarts.
+ *
+ * Every client has its own directory under the root directory, named after the hexadecimal encoding
+ * of its identifier. The directory holds a sequence of fixed-size segments, where notification
+ * frames are appended back-to-back, and a read cursor. Appended frames are made durable in groups,
+ * whenever `commit` is invoked. Upon reconnection, frames are sent to the client straight from the
+ * segment files, using `sendfile`, as long as its socket accepts them. The replay goes on once the
+ * egress drained the socket.
+ */
+class StoreForwardLog : public StoreForward
+{
+public:
+  static constexpr std::size_t SEGMENT_SIZE = 8 << 20;
+
+  /**
+   * \brief Open the log stored in the directory \p root, creating it if needed. Frames left in the
+   * directory by a previous run are recovered.
+   */
+  explicit StoreForwardLog(std::string root);
+
+  StoreForwardLog(const StoreForwardLog &) = delete;
+  StoreForwardLog &operator=(const StoreForwardLog &) = delete;
+
+  ~StoreForwardLog() override;
+
+  void append(SubscriberConnection &client,
+      std::string_view topic,
+      const SharedFrame &frame) override;
+
+  void replay(SubscriberConnection &client, Egress &egress) override;
+
+  void commit() override;
+
+private:
+  struct Segment
+  {
+    std::uint64_t seq;
+    int fd;
+    std::uint8_t *base;  // The whole file, mapped in memory.
+  };
+
+  struct ClientLog
+  {
+    std::string dir;
+    std::deque<Segment> segments;
+    std::uint64_t next_seq = 0;
+
+    /* Position of the first frame not yet delivered. */
+    std::uint64_t cursor_seq = 0;
+    std::uint64_t cursor_offset = 0;
+    int cursor_fd = -1;
+
+    /* Offset up to which the last segment has been made durable. */
+    std::uint64_t synced = 0;
+    bool dirty = false;
+  };
+
+  ClientLog &log_of(const std::string &client_id);
+
+  /* Load the logs left in the root directory by a previous run. */
+  void recover();
+
+  Segment open_segment(const std::string &dir, std::uint64_t seq, bool create);
+  void close_segment(const std::string &dir, Segment &segment, bool remove);
+
+  void sync_tail(ClientLog &log);
+  void save_cursor(ClientLog &log);
+
+private:
+  std::string root_;
+  std::unordered_map<std::string, ClientLog> logs_;
+
+  /* Logs with frames appended since the last commit. */
+  std::vector<ClientLog *> dirty_;
+};
+
+}  // namespace gateway
@@ -1,24 +1,67 @@
 #pragma once
 
 #include "commons/subscriber_messages.h"
+#include "gateway/intern_table.h"
 #include "microloop/net/tcp_server.h"
+#include "net_utils/buffer_pool.h"
 
+#include <cstdint>
+#include <deque>
 #include <functional>
-#include <queue>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace gateway
 {
 
-struct Subscription
+/**
+ * \brief Immutable, reference-counted wire frame. A frame is serialized once per message and shared
+ * by every connection and Store&Forward queue it is delivered to.
+ */
+using SharedFrame = std::shared_ptr<const microloop::Buffer>;
+
+/**
+ * \brief Wrap a serialized frame into a shared frame. The buffer is given back to the buffer pool
+ * of the releasing thread once the last reference to the frame is dropped.
+ */
+inline SharedFrame make_shared_frame(microloop::Buffer &&buf)
 {
-  /* The client identifier. */
-  std::string client_id;
+  return SharedFrame{new microloop::Buffer{std::move(buf)}, [](const microloop::Buffer *frame) {
+                       auto owned = const_cast<microloop::Buffer *>(frame);
+                       net_utils::BufferPool::local().release(std::move(*owned));
+                       delete owned;
+                     }};
+}
 
-  /* The topic identifier. */
-  std::string topic;
+struct Subscription
+{
+  /* The handle of the topic, interned by the subscribers storage. */
+  InternTable::Handle topic;
 
   /* Whether the Store&Forward feature is enabled for this subscription. */
   bool store_forward;
+
+  /* Whether notifications are conflated, so only the latest one of the topic is ever queued. */
+  bool conflate = false;
+
+  /* The position of the client in the subscribers of the topic, unless the topic is a pattern. */
+  std::uint32_t slot = 0;
+};
+
+struct SubscriberConnection;
+
+/* A client subscribed to a topic or pattern, as listed by the routing indexes. */
+struct TopicSubscriber
+{
+  /* The client, owned by the subscribers storage, which removes it from the indexes first. */
+  SubscriberConnection *client;
+
+  /* Whether only the latest notification of the topic matters to the client. */
+  bool conflate;
 };
 
 struct SubscriberConnection
@@ -29,13 +72,73 @@ struct SubscriberConnection
   /* The client ID as provided by the Greeting message from a client upon connection. */
   std::string client_id;
 
-  /* Messages to be sent upon susbcriber re-connection. */
-  std::queue<commons::subscriber_messages::DeviceNotification> pending_messages;
+  /* The handle of the client identifier, interned by the subscribers storage. */
+  InternTable::Handle handle = InternTable::NONE;
+
+  /* The protocol version negotiated through the Greeting message of the current connection. */
+  std::uint8_t protocol = commons::subscriber_messages::PROTOCOL_V1;
+
+  /*
+   * The binding of every topic identifier defined on the current connection, for protocol version
+   * 3, or zero if the identifier was not defined.
+   */
+  std::vector<std::uint32_t> defined_topics;
+
+  /**
+   * Store&Forward cursors, one for each topic with messages to be sent upon subscriber
+   * re-connection. The keys view the topics owned by the Store&Forward storage.
+   */
+  std::unordered_map<std::string_view, std::uint64_t> sf_cursors;
+
+  /* The subscriptions of the client by topic handle, kept while offline if Store&Forward. */
+  std::unordered_map<InternTable::Handle, Subscription> subscriptions;
+
+  /*
+   * The latest notification of every topic, kept while the socket does not accept more bytes for a
+   * conflating subscription, or while the outbound queue is congested and the overflow policy
+   * conflates notifications. Indexed by the handle of the topic among the conflated topics of the
+   * subscribers storage, which manages the slots. Frames use the version 1 encoding.
+   */
+  std::vector<SharedFrame> conflated;
+
+  /* The handles of the topics with a notification in `conflated`, oldest first. */
+  std::deque<InternTable::Handle> conflated_topics;
+
+  /* Whether notifications were spilled to the Store&Forward storage while congested. */
+  bool spilled = false;
+
+  /*
+   * Whether a replay of the Store&Forward storage waits for the socket to drain. Notifications are
+   * stored behind the frames left meanwhile.
+   */
+  bool replaying = false;
 
   bool active() const
   {
     return raw_conn != nullptr;
   }
+
+  /**
+   * \brief Mark the binding \p binding of the topic identifier \p id as defined on the current
+   * connection.
+   * \returns Whether the identifier was not defined before, or was bound to another topic, so its
+   * definition is to be sent.
+   */
+  bool define_topic(std::uint32_t id, std::uint32_t binding)
+  {
+    if (id >= defined_topics.size())
+    {
+      defined_topics.resize(id + 1);
+    }
+
+    if (defined_topics[id] == binding)
+    {
+      return false;
+    }
+
+    defined_topics[id] = binding;
+    return true;
+  }
 };
 
 }  // namespace gateway
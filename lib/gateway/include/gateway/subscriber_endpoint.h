@@ -1,13 +1,20 @@
 #pragma once
 
+#include "commons/frame_decoder.h"
 #include "commons/subscriber_messages.h"
+#include "gateway/egress.h"
+#include "gateway/last_value_cache.h"
+#include "gateway/store_forward.h"
 #include "gateway/subscriber_conn.h"
 #include "gateway/subscribers_storage.h"
 #include "microloop/kernel_exception.h"
 #include "microloop/net/tcp_server.h"
 
+#include <cstdint>
 #include <netinet/tcp.h>
+#include <string_view>
 #include <sys/socket.h>
+#include <unordered_map>
 
 namespace gateway::endpoint
 {
@@ -15,7 +22,16 @@ namespace gateway::endpoint
 class SubscriberEndpoint
 {
 public:
-  SubscriberEndpoint(std::uint16_t port, SubscribersStorage &ss) : server_{port}, subscribers_{ss}
+  SubscriberEndpoint(std::uint16_t port,
+      SubscribersStorage &ss,
+      Egress &egress,
+      StoreForward &store_forward,
+      LastValueCache &last_values) :
+      subscribers_{ss},
+      egress_{egress},
+      store_forward_{store_forward},
+      last_values_{last_values},
+      server_{port}
   {
     if (int f = 1; setsockopt(server_.fd(), SOL_TCP, TCP_NODELAY, &f, sizeof(f)) == -1)
     {
@@ -26,6 +42,12 @@ public:
     server_.set_data_callback(&SubscriberEndpoint::on_tcp_data, this);
   }
 
+  /**
+   * \brief Disconnect a subscriber, as if it had closed its connection. Its Store&Forward
+   * subscriptions are kept.
+   */
+  void drop(SubscriberConnection &subscriber);
+
 private:
   /* Callback to be invoked when a new client connects. */
   void on_tcp_conn(microloop::net::TcpServer::PeerConnection &conn);
@@ -33,6 +55,23 @@ private:
   /* Callback to be invoked when new data arrives on the TCP endpoint. */
   void on_tcp_data(microloop::net::TcpServer::PeerConnection &conn, const microloop::Buffer &buf);
 
+  /**
+   * \brief Callback to be invoked for every whole message decoded from a TCP connection.
+   * \returns Whether the connection is still open, so the following messages may be handled.
+   */
+  bool on_message(microloop::net::TcpServer::PeerConnection &conn,
+      const std::uint8_t *frame,
+      std::size_t size);
+
+  /* The protocol version to be used for a connection, which is version 1 until the greeting. */
+  std::uint8_t protocol_of(microloop::net::TcpServer::PeerConnection &conn);
+
+  /* Close a connection which cannot be served any longer. */
+  void close(microloop::net::TcpServer::PeerConnection &conn);
+
+  /* Send a serialized message to a peer through the outbound path. */
+  bool send(microloop::net::TcpServer::PeerConnection &conn, microloop::Buffer &&frame);
+
   /* Callback to be invoked when a client disconnects. */
   void on_disconnect(SubscriberConnection &client);
 
@@ -47,9 +86,33 @@ private:
   void on_unsubscribe(SubscriberConnection &subscriber,
       const commons::subscriber_messages::UnsubscribeRequest &msg);
 
+  /* Callback to be invoked when a client sends a bulk subscribe request. */
+  void on_bulk_subscribe(SubscriberConnection &subscriber,
+      const commons::subscriber_messages::BulkSubscribeRequest &msg);
+
+  /* Callback to be invoked when a client sends a bulk unsubscribe request. */
+  void on_bulk_unsubscribe(SubscriberConnection &subscriber,
+      const commons::subscriber_messages::BulkUnsubscribeRequest &msg);
+
+  /* Callback to be invoked when a client asks for the latest notification of its topics. */
+  void on_snapshot(SubscriberConnection &subscriber);
+
+  /**
+   * \brief Send the latest notification of \p topic from the last value cache, if any, or those
+   * of all the cached topics matching \p topic if it is a pattern.
+   * \returns The number of notifications sent.
+   */
+  std::size_t send_last_values(SubscriberConnection &subscriber, std::string_view topic);
+
 private:
   SubscribersStorage &subscribers_;
+  Egress &egress_;
+  StoreForward &store_forward_;
+  LastValueCache &last_values_;
   microloop::net::TcpServer server_;
+
+  /* Decoders of the TCP streams, including those of pending connections, by file descriptor. */
+  std::unordered_map<std::uint32_t, commons::subscriber_messages::FrameDecoder> decoders_;
 };
 
 }  // namespace gateway::endpoint
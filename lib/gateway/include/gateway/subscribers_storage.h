@@ -2,20 +2,29 @@
 
 #include "commons/device_messages.h"
 #include "commons/subscriber_messages.h"
+#include "gateway/intern_table.h"
 #include "gateway/subscriber_conn.h"
+#include "gateway/topic_filter.h"
+#include "gateway/topic_trie.h"
 #include "microloop/net/tcp_server.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <functional>
-#include <map>
-#include <set>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace gateway
 {
 
 class SubscribersStorage
 {
+  using SubscriptionIt = decltype(SubscriberConnection::subscriptions)::iterator;
+
 public:
   /**
    * \brief Add a new incoming connection without a client identifier. Such information is meant to
@@ -35,21 +44,16 @@ public:
    * identifier \p id, but that connection does not have an active TCP tunnel, it will be returned
    * only if \p include_inactive is `true`.
    */
-  SubscriberConnection *named(std::string id, bool include_inactive = false)
+  SubscriberConnection *named(std::string_view id, bool include_inactive = false)
   {
-    for (auto &c : connections_)
+    auto handle = clients_.find(id);
+    if (handle == InternTable::NONE)
     {
-      if ((c.raw_conn || include_inactive) && c.client_id == id)
-      {
-        return &c;
-      }
-      else if (!c.raw_conn && !include_inactive)
-      {
-        return nullptr;
-      }
+      return nullptr;
     }
 
-    return nullptr;
+    auto c = connections_[handle].get();
+    return c->raw_conn || include_inactive ? c : nullptr;
   }
 
   /**
@@ -60,15 +64,8 @@ public:
    */
   SubscriberConnection *with_fd(std::uint32_t fd)
   {
-    for (auto &c : connections_)
-    {
-      if (c.raw_conn && c.raw_conn->fd() == fd)
-      {
-        return &c;
-      }
-    }
-
-    return nullptr;
+    auto it = by_fd_.find(fd);
+    return it != by_fd_.end() ? it->second : nullptr;
   }
 
   /**
@@ -92,27 +89,34 @@ public:
    * optional object.
    */
   SubscriberConnection *attach_client_id(microloop::net::TcpServer::PeerConnection &conn,
-      std::string id)
+      std::string_view id)
   {
     pending_conns_.erase(conn.fd());
 
-    for (auto &c : connections_)
+    auto handle = clients_.find(id);
+    if (handle == InternTable::NONE)
     {
-      if (c.client_id == id)
+      handle = clients_.acquire(id);
+      if (handle == connections_.size())
       {
-        if (c.raw_conn)
-        {
-          return nullptr;
-        }
-
-        c.raw_conn = &conn;
-        return &c;
+        connections_.emplace_back();
       }
+
+      connections_[handle] =
+          std::make_unique<SubscriberConnection>(SubscriberConnection{nullptr, std::string{id}});
+      connections_[handle]->handle = handle;
+    }
+
+    auto &c = *connections_[handle];
+    if (c.raw_conn)
+    {
+      return nullptr;
     }
 
-    /* Reaching up to this point means we do not have a connection with this ID. */
+    c.raw_conn = &conn;
+    by_fd_.emplace(conn.fd(), &c);
 
-    return &connections_.emplace_back(SubscriberConnection{&conn, id});
+    return &c;
   }
 
   /**
@@ -133,23 +137,24 @@ public:
       return;
     }
 
-    auto conn_it = std::find_if(connections_.begin(), connections_.end(),
-        [&conn](auto &&c) { return c.raw_conn && c.raw_conn->fd() == conn.fd(); });
-
-    if (conn_it == connections_.end())
+    auto fd_it = by_fd_.find(conn.fd());
+    if (fd_it == by_fd_.end())
     {
       return;
     }
 
-    conn_it->raw_conn = nullptr;
+    auto &client = *fd_it->second;
+    by_fd_.erase(fd_it);
+
+    client.raw_conn = nullptr;
+    clear_conflated(client);
 
+    /* Only the subscriptions of the client are visited. */
     auto sf_enabled_subs_count = 0;
 
-    for (auto it = subscriptions_.begin(); it != subscriptions_.end();)
+    for (auto it = client.subscriptions.begin(); it != client.subscriptions.end();)
     {
-      auto &[_, s] = *it;
-
-      if (s.store_forward)
+      if (it->second.store_forward)
       {
         sf_enabled_subs_count++;
         it++;
@@ -157,17 +162,20 @@ public:
       else
       {
         /* Erase subscriptions with Store&Forward disabled. */
-        it = subscriptions_.erase(it);
+        it = drop(client, it);
       }
     }
 
-    if (sf_enabled_subs_count)
+    /* Notifications spilled while the subscriber was congested are also kept for it. */
+    if (sf_enabled_subs_count || !client.sf_cursors.empty())
     {
       return;
     }
 
-    /* Remove the connection itself */
-    connections_.erase(conn_it);
+    /* Remove the connection itself, which frees its handle for the next client. */
+    auto handle = client.handle;
+    connections_[handle].reset();
+    clients_.release(handle);
   }
 
   /**
@@ -175,19 +183,21 @@ public:
    * \p topic.
    * \returns Whether a subscription matching the given criteria was found and removed or not.
    */
-  bool remove_subscription(std::string client_id, std::string topic)
+  bool remove_subscription(std::string_view client_id, std::string_view topic)
   {
-    auto it = std::find_if(subscriptions_.begin(), subscriptions_.end(), [&](auto &&p) {
-      auto &[k, s] = p;
-      return s.topic == topic && k == client_id;
-    });
+    auto client = named(client_id, true);
+    if (!client)
+    {
+      return false;
+    }
 
-    if (it == subscriptions_.end())
+    auto it = client->subscriptions.find(topics_.find(topic));
+    if (it == client->subscriptions.end())
     {
       return false;
     }
 
-    subscriptions_.erase(it);
+    drop(*client, it);
     return true;
   }
 
@@ -198,49 +208,367 @@ public:
    * \return The newly allocated subscription, or `nullptr` if the client was already subscribed
    * to the topic in the request.
    */
-  Subscription *add_subscription(std::string client_id,
+  Subscription *add_subscription(std::string_view client_id,
       const commons::subscriber_messages::SubscribeRequest &req)
   {
-    auto [first, last] = subscriptions_.equal_range(client_id);
-    for (auto it = first; it != last; ++it)
+    auto client = named(client_id, true);
+    if (!client)
+    {
+      return nullptr;
+    }
+
+    return subscribe(*client, req);
+  }
+
+  /**
+   * \brief Add several subscriptions to the client identified by \p client_id, as a single batch.
+   * \returns Whether each of the subscriptions was added, in the order of \p reqs. A subscription
+   * is not added if the client was already subscribed to its topic, or if its topic is an invalid
+   * pattern.
+   */
+  std::vector<bool> add_subscriptions(std::string_view client_id,
+      const std::vector<commons::subscriber_messages::SubscribeRequest> &reqs)
+  {
+    std::vector<bool> added(reqs.size());
+
+    auto client = named(client_id, true);
+    if (!client)
+    {
+      return added;
+    }
+
+    for (std::size_t i = 0; i < reqs.size(); i++)
+    {
+      auto &req = reqs[i];
+      if (!TopicTrie::valid(req.topic))
+      {
+        continue;
+      }
+
+      added[i] = subscribe(*client, req) != nullptr;
+    }
+
+    return added;
+  }
+
+  /**
+   * \brief Remove the subscriptions of the client identified by \p client_id to \p topics, as a
+   * single batch.
+   * \returns Whether a subscription was found and removed for each topic, in the order of
+   * \p topics.
+   */
+  std::vector<bool> remove_subscriptions(std::string_view client_id,
+      const std::vector<commons::subscriber_messages::Topic> &topics)
+  {
+    std::vector<bool> removed(topics.size());
+
+    auto client = named(client_id, true);
+    if (!client)
+    {
+      return removed;
+    }
+
+    for (std::size_t i = 0; i < topics.size(); i++)
+    {
+      auto it = client->subscriptions.find(topics_.find(topics[i]));
+      if (it == client->subscriptions.end())
+      {
+        continue;
+      }
+
+      drop(*client, it);
+      removed[i] = true;
+    }
+
+    return removed;
+  }
+
+  /**
+   * \brief Get all the clients subscribed to \p topic, either exactly or through patterns.
+   * \param out Filled with the subscribers, each client listed once. The list is invalidated by any
+   * change to the subscriptions.
+   */
+  void match(std::string_view topic, std::vector<const TopicSubscriber *> &out) const
+  {
+    out.clear();
+
+    if (auto handle = topics_.find(topic); handle != InternTable::NONE)
+    {
+      for (auto &subscriber : topic_index_[handle])
+      {
+        out.push_back(&subscriber);
+      }
+    }
+
+    if (patterns_.empty())
+    {
+      return;
+    }
+
+    auto exact = out.size();
+    patterns_.match(topic, out);
+
+    if (out.size() == exact || out.size() == 1)
+    {
+      return;
+    }
+
+    /*
+     * A client subscribed both exactly and through patterns gets a single notification. It is
+     * conflated if any of the matching subscriptions is, so the conflating ones are sorted first
+     * for every client, and the first one is kept.
+     */
+    auto by_client = [](auto &&a, auto &&b) {
+      return a->client != b->client ? a->client < b->client : a->conflate > b->conflate;
+    };
+    auto same_client = [](auto &&a, auto &&b) { return a->client == b->client; };
+
+    std::sort(out.begin(), out.end(), by_client);
+    out.erase(std::unique(out.begin(), out.end(), same_client), out.end());
+  }
+
+  /**
+   * \brief Keep \p frame as the latest notification of \p topic for \p client, in place of the one
+   * kept before, until taken by take_conflated().
+   * \param handle The handle of \p topic among the conflated topics, or NONE. Set by the first call
+   * for a message, so the topic is only looked up once for all the subscribers of the message.
+   */
+  void conflate(SubscriberConnection &client,
+      std::string_view topic,
+      InternTable::Handle &handle,
+      const SharedFrame &frame)
+  {
+    if (handle == InternTable::NONE)
+    {
+      handle = conflated_topics_.find(topic);
+    }
+
+    /* Every slot holds a reference to its topic, taken along with the first frame. */
+    if (handle == InternTable::NONE)
+    {
+      handle = conflated_topics_.acquire(topic);
+    }
+    else if (handle >= client.conflated.size() || !client.conflated[handle])
+    {
+      conflated_topics_.retain(handle);
+    }
+    else
+    {
+      client.conflated[handle] = frame;
+      return;
+    }
+
+    if (handle >= client.conflated.size())
+    {
+      client.conflated.resize(conflated_topics_.capacity());
+    }
+
+    client.conflated[handle] = frame;
+    client.conflated_topics.push_back(handle);
+  }
+
+  /* Take the oldest notification kept by conflate() for \p client, which must have any. */
+  SharedFrame take_conflated(SubscriberConnection &client)
+  {
+    auto handle = client.conflated_topics.front();
+    client.conflated_topics.pop_front();
+
+    auto frame = std::move(client.conflated[handle]);
+    conflated_topics_.release(handle);
+
+    return frame;
+  }
+
+  /* Drop the notifications kept by conflate() for \p client. */
+  void clear_conflated(SubscriberConnection &client)
+  {
+    while (!client.conflated_topics.empty())
     {
-      auto &[_, s] = *it;
-      if (s.topic == req.topic)
+      take_conflated(client);
+    }
+  }
+
+  /**
+   * \brief Get the approximate set of the topics with subscribers, kept in sync with the
+   * subscriptions.
+   */
+  const TopicFilter &topic_filter() const
+  {
+    return filter_;
+  }
+
+  /**
+   * \brief Invoke \p func with every subscriber connection, including those without an active TCP
+   * tunnel.
+   */
+  template <class Func>
+  void for_each_connection(Func &&func) const
+  {
+    for (auto &c : connections_)
+    {
+      if (c)
       {
-        return nullptr;
+        func(static_cast<const SubscriberConnection &>(*c));
       }
     }
+  }
+
+  /* The topic, or pattern, of a subscription. */
+  std::string_view topic_of(const Subscription &s) const
+  {
+    return topics_.str(s.topic);
+  }
+
+  /* The number of subscriber connections, including those without an active TCP tunnel. */
+  std::size_t client_count() const
+  {
+    return clients_.size();
+  }
 
-    Subscription s{client_id, req.topic, req.store_forward};
-    auto &[key, val] = *subscriptions_.emplace(client_id, std::move(s));
-    return &val;
+  /* The number of distinct topics and patterns subscribed to. */
+  std::size_t topic_count() const
+  {
+    return topics_.size();
   }
 
+private:
   /**
-   * \brief Get all the subscriptions of all registered subscribers.
+   * \brief Add a subscription of \p client, as described by \p req, and index it.
+   * \returns The new subscription, or `nullptr` if the client was already subscribed to the topic.
    */
-  const auto &subscriptions() const
+  Subscription *subscribe(SubscriberConnection &client,
+      const commons::subscriber_messages::SubscribeRequest &req)
   {
-    return subscriptions_;
+    auto topic = topics_.acquire(req.topic);
+
+    Subscription s{topic, req.store_forward, req.conflate};
+    auto [it, added] = client.subscriptions.emplace(topic, s);
+    if (!added)
+    {
+      topics_.release(topic);
+      return nullptr;
+    }
+
+    index(client, it->second);
+    return &it->second;
   }
 
-  auto &subscriptions()
+  /**
+   * \brief Remove the subscription at \p it from the subscriptions of \p client, and from the
+   * index.
+   * \returns The subscription following the removed one.
+   */
+  SubscriptionIt drop(SubscriberConnection &client, SubscriptionIt it)
   {
-    return subscriptions_;
+    auto topic = it->second.topic;
+
+    unindex(client, it->second);
+    it = client.subscriptions.erase(it);
+    topics_.release(topic);
+
+    return it;
+  }
+
+  /* Add \p client to the list of subscribers of the topic of \p s. */
+  void index(SubscriberConnection &client, Subscription &s)
+  {
+    auto topic = topics_.str(s.topic);
+
+    if (TopicTrie::is_pattern(topic))
+    {
+      patterns_.insert(topic, TopicSubscriber{&client, s.conflate});
+      filter_pattern(topic, true);
+
+      return;
+    }
+
+    if (s.topic >= topic_index_.size())
+    {
+      topic_index_.resize(topics_.capacity());
+    }
+
+    auto &subscribers = topic_index_[s.topic];
+    if (subscribers.empty())
+    {
+      filter_.add(topic);
+    }
+
+    s.slot = static_cast<std::uint32_t>(subscribers.size());
+    subscribers.push_back(TopicSubscriber{&client, s.conflate});
   }
 
   /**
-   * \brief Get the subscriptions associated with a client at a given moment.
+   * \brief Remove \p client from the list of subscribers of the topic of \p s. The order of
+   * subscribers of a topic is not relevant, so the last one takes the place of the removed one,
+   * and the subscription it belongs to is told about its new slot.
    */
-  auto subscriptions(std::string client_id) const
+  void unindex(SubscriberConnection &client, const Subscription &s)
+  {
+    auto topic = topics_.str(s.topic);
+
+    if (TopicTrie::is_pattern(topic))
+    {
+      if (patterns_.erase(topic, &client))
+      {
+        filter_pattern(topic, false);
+      }
+
+      return;
+    }
+
+    auto &subscribers = topic_index_[s.topic];
+    if (s.slot != subscribers.size() - 1)
+    {
+      auto &moved = subscribers[s.slot] = subscribers.back();
+      moved.client->subscriptions.find(s.topic)->second.slot = s.slot;
+    }
+
+    subscribers.pop_back();
+
+    if (subscribers.empty())
+    {
+      filter_.remove(topic);
+    }
+  }
+
+  /* Add a pattern to the topic filter, or remove it, by its first level. */
+  void filter_pattern(std::string_view pattern, bool add)
   {
-    return subscriptions_.equal_range(client_id);
+    auto level = pattern.substr(0, pattern.find(TopicTrie::SEPARATOR));
+
+    if (TopicTrie::is_pattern(level))
+    {
+      add ? filter_.add_any() : filter_.remove_any();
+    }
+    else
+    {
+      add ? filter_.add_prefix(level) : filter_.remove_prefix(level);
+    }
   }
 
 private:
-  std::vector<SubscriberConnection> connections_;
-  std::multimap<std::string, Subscription> subscriptions_;
-  std::set<std::uint32_t> pending_conns_;
+  /* The client identifiers, whose handles index the connections. */
+  InternTable clients_;
+  std::vector<std::unique_ptr<SubscriberConnection>> connections_;
+
+  /* The connections with an active TCP tunnel, by file descriptor. */
+  std::unordered_map<std::uint32_t, SubscriberConnection *> by_fd_;
+  std::unordered_set<std::uint32_t> pending_conns_;
+
+  /* The topics and patterns subscribed to, whose handles index the subscribed clients. */
+  InternTable topics_;
+
+  /* The topics of the notifications kept by conflation slots, whose handles index the slots. */
+  InternTable conflated_topics_;
+
+  /* Topic to subscribed clients index, used to route device messages. Empty for patterns. */
+  std::vector<std::vector<TopicSubscriber>> topic_index_;
+
+  /* Subscriptions to topic patterns, also used to route device messages. */
+  TopicTrie patterns_;
+
+  /* The topics of the index, checked by the input endpoint to discard unwanted datagrams. */
+  TopicFilter filter_;
 };
 
 }  // namespace gateway
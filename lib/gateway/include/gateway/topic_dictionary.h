@@ -0,0 +1,102 @@
+#pragma once
+
+#include "commons/subscriber_messages.h"
+#include "gateway/subscriber_conn.h"
+
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace gateway
+{
+
+/**
+ * \brief Identifiers of the topics sent to protocol version 3 subscribers.
+ *
+ * Identifiers are shared by all the connections, so a tagged notification is serialized once for
+ * all of them, while every connection gets the definition of a topic before its first use. Once all
+ * the identifiers are taken, the identifier of the least recently used topic is bound to the new
+ * one. Every binding of an identifier is numbered, so connections holding an older binding get the
+ * new definition before the next notification tagged with it.
+ */
+class TopicDictionary
+{
+public:
+  struct Topic
+  {
+    std::string name;
+    std::uint32_t id;
+
+    /* The number of topics bound to the identifier so far, this one included. */
+    std::uint32_t binding;
+
+    /* The TOPIC_DEFINITION frame binding the identifier to the topic. */
+    SharedFrame definition;
+  };
+
+  explicit TopicDictionary(std::size_t capacity = commons::subscriber_messages::TOPIC_ID_COUNT) :
+      capacity_{capacity}
+  {}
+
+  /**
+   * \brief Retrieve the entry of \p topic, binding it to an identifier if it has none yet. The
+   * entry stays valid until the next call.
+   */
+  const Topic &lookup(std::string_view topic)
+  {
+    using commons::subscriber_messages::TopicDefinition;
+
+    if (auto it = topics_.find(topic); it != topics_.end())
+    {
+      /* The most recently used topics are kept first. */
+      lru_.splice(lru_.begin(), lru_, it->second);
+      return lru_.front();
+    }
+
+    if (lru_.size() < capacity_)
+    {
+      lru_.push_front(Topic{{}, static_cast<std::uint32_t>(lru_.size()), 0, {}});
+    }
+    else
+    {
+      topics_.erase(lru_.back().name);
+      lru_.splice(lru_.begin(), lru_, std::prev(lru_.end()));
+      reclaimed_++;
+    }
+
+    auto &entry = lru_.front();
+    entry.name = topic;
+    entry.binding++;
+    entry.definition = make_shared_frame(TopicDefinition{entry.id, entry.name}.serialize());
+
+    /* The key views the name owned by the entry, which never moves in memory. */
+    topics_.emplace(entry.name, lru_.begin());
+
+    return entry;
+  }
+
+  std::size_t size() const
+  {
+    return lru_.size();
+  }
+
+  /* The number of identifiers bound to another topic since the start. */
+  std::uint64_t reclaimed() const
+  {
+    return reclaimed_;
+  }
+
+private:
+  std::size_t capacity_;
+
+  /* The topics bound to an identifier, the most recently used first. */
+  std::list<Topic> lru_;
+  std::unordered_map<std::string_view, std::list<Topic>::iterator> topics_;
+
+  std::uint64_t reclaimed_ = 0;
+};
+
+}  // namespace gateway
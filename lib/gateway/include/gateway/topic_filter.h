@@ -0,0 +1,101 @@
+#pragma once
+
+#include "gateway/topic_trie.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+namespace gateway
+{
+
+/**
+ * \brief Approximate set of the topics with subscribers, checked against the raw topic of every
+ * datagram so the unwanted ones are discarded before being parsed.
+ *
+ * Topics are hashed into a fixed table of counters. A topic may be reported as subscribed when it
+ * shares its counter with a subscribed one, but never the other way around. Patterns are tracked
+ * by their first level, so they let through all the topics starting with it, or all the topics
+ * when their first level is a wildcard. Topics are added and removed on the event loop thread,
+ * while the ingest threads may check them concurrently.
+ */
+class TopicFilter
+{
+public:
+  static constexpr std::size_t SLOTS = 1 << 16;
+
+  TopicFilter() : counts_(SLOTS)
+  {}
+
+  TopicFilter(const TopicFilter &) = delete;
+  TopicFilter &operator=(const TopicFilter &) = delete;
+
+  void add(std::string_view topic)
+  {
+    counts_[slot(topic)].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void remove(std::string_view topic)
+  {
+    counts_[slot(topic)].fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  /* Let through the topics whose first level is \p level, as a pattern starting with it. */
+  void add_prefix(std::string_view level)
+  {
+    counts_[slot(level)].fetch_add(1, std::memory_order_relaxed);
+    prefixes_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void remove_prefix(std::string_view level)
+  {
+    counts_[slot(level)].fetch_sub(1, std::memory_order_relaxed);
+    prefixes_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  /* Let through all the topics, as a pattern starting with a wildcard. */
+  void add_any()
+  {
+    any_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void remove_any()
+  {
+    any_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  /* Whether \p topic may have subscribers. */
+  bool may_contain(std::string_view topic) const
+  {
+    if (any_.load(std::memory_order_relaxed) != 0 ||
+        counts_[slot(topic)].load(std::memory_order_relaxed) != 0)
+    {
+      return true;
+    }
+
+    auto sep = topic.find(TopicTrie::SEPARATOR);
+    if (sep == std::string_view::npos || prefixes_.load(std::memory_order_relaxed) == 0)
+    {
+      return false;
+    }
+
+    return counts_[slot(topic.substr(0, sep))].load(std::memory_order_relaxed) != 0;
+  }
+
+private:
+  static std::size_t slot(std::string_view topic)
+  {
+    return std::hash<std::string_view>{}(topic) % SLOTS;
+  }
+
+private:
+  std::vector<std::atomic<std::uint32_t>> counts_;
+
+  /* Patterns tracked by their first level, and patterns starting with a wildcard. */
+  std::atomic<std::uint32_t> prefixes_{0};
+  std::atomic<std::uint32_t> any_{0};
+};
+
+}  // namespace gateway
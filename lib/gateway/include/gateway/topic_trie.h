@@ -0,0 +1,101 @@
+#pragma once
+
+#include "gateway/subscriber_conn.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace gateway
+{
+
+/**
+ * \brief Subscriptions to topic patterns, indexed by their levels.
+ *
+ * Topics are made of levels separated by '/'. In a pattern, a '+' level matches any single level,
+ * and a trailing '#' level matches any number of levels, including none. Looking up a topic walks
+ * the trie once per level, following the exact and '+' branches, so its cost depends on the number
+ * of levels and not on the number of patterns.
+ */
+class TopicTrie
+{
+public:
+  static constexpr char SEPARATOR = '/';
+  static constexpr std::string_view SINGLE_LEVEL = "+";
+  static constexpr std::string_view MULTI_LEVEL = "#";
+
+  /* Whether \p topic has wildcard levels, which makes it a pattern. */
+  static bool is_pattern(std::string_view topic);
+
+  /* Whether the wildcards of \p topic are whole levels, and a '#' level is the last one. */
+  static bool valid(std::string_view topic);
+
+  /* Whether \p topic matches the valid pattern \p pattern. */
+  static bool matches(std::string_view pattern, std::string_view topic);
+
+  /* Add a subscriber of the valid pattern \p pattern. */
+  void insert(std::string_view pattern, TopicSubscriber subscriber);
+
+  /**
+   * \brief Remove the subscription of \p client to \p pattern.
+   * \returns Whether the subscription was found.
+   */
+  bool erase(std::string_view pattern, const SubscriberConnection *client);
+
+  /**
+   * \brief Append the subscribers of all the patterns matching \p topic to \p out. A client is
+   * appended once for every pattern it matches by.
+   */
+  void match(std::string_view topic, std::vector<const TopicSubscriber *> &out) const;
+
+  /* The number of pattern subscriptions. */
+  std::size_t size() const
+  {
+    return size_;
+  }
+
+  bool empty() const
+  {
+    return size_ == 0;
+  }
+
+private:
+  struct Node
+  {
+    /* The level leading to this node, owned here so it can be viewed by the parent. */
+    std::string level;
+
+    std::unordered_map<std::string_view, std::unique_ptr<Node>> children;
+
+    /* The child for a '+' level. */
+    std::unique_ptr<Node> any;
+
+    /* The subscribers of the patterns ending at this node. */
+    std::vector<TopicSubscriber> subscribers;
+
+    /* The subscribers of the patterns ending with a '#' level right below this node. */
+    std::vector<TopicSubscriber> descendants;
+
+    bool empty() const
+    {
+      return children.empty() && !any && subscribers.empty() && descendants.empty();
+    }
+  };
+
+  void match(const Node &node,
+      std::string_view rest,
+      bool done,
+      std::vector<const TopicSubscriber *> &out) const;
+
+  /* Remove a subscription below \p node, pruning the nodes left empty on the way back. */
+  bool erase(Node &node, std::string_view rest, const SubscriberConnection *client);
+
+private:
+  Node root_;
+  std::size_t size_ = 0;
+};
+
+}  // namespace gateway
@@ -0,0 +1,96 @@
+#include "gateway/device_sources.h"
+
+#include <algorithm>
+
+namespace gateway
+{
+
+DeviceSources::DeviceSources(std::size_t capacity) : capacity_{std::max<std::size_t>(capacity, 1)}
+{
+  slots_.reserve(capacity_);
+  index_.reserve(capacity_);
+}
+
+DeviceSources::Source &DeviceSources::lookup(const net_utils::AddressWrapper &source)
+{
+  auto key = make_key(source);
+
+  if (auto it = index_.find(key); it != index_.end())
+  {
+    auto &slot = slots_[it->second];
+    slot.referenced = true;
+
+    return slot.source;
+  }
+
+  std::uint32_t slot_idx;
+  if (slots_.size() < capacity_)
+  {
+    slot_idx = slots_.size();
+    slots_.emplace_back();
+  }
+  else
+  {
+    slot_idx = evict();
+  }
+
+  auto &slot = slots_[slot_idx];
+  slot.key = key;
+  slot.referenced = true;
+  slot.source = Source{};
+
+  auto address = source.str();
+  slot.source.address_len = std::min(address.size(), sizeof(slot.source.address));
+  std::memcpy(slot.source.address, address.data(), slot.source.address_len);
+  std::memcpy(slot.source.address_bin, key.bytes, sizeof(key.bytes));
+
+  index_.emplace(key, slot_idx);
+
+  return slot.source;
+}
+
+std::size_t DeviceSources::KeyHash::operator()(const Key &key) const
+{
+  /* FNV-1a, which is fast and good enough for the few bytes of a socket address. */
+  std::uint64_t hash = 14695981039346656037ull;
+  for (auto b : key.bytes)
+  {
+    hash ^= b;
+    hash *= 1099511628211ull;
+  }
+
+  return hash;
+}
+
+DeviceSources::Key DeviceSources::make_key(const net_utils::AddressWrapper &source)
+{
+  Key key;
+  source.to_binary(key.bytes);
+
+  return key;
+}
+
+std::uint32_t DeviceSources::evict()
+{
+  while (true)
+  {
+    auto &slot = slots_[clock_hand_];
+    auto slot_idx = clock_hand_;
+
+    clock_hand_ = (clock_hand_ + 1) % slots_.size();
+
+    if (slot.referenced)
+    {
+      /* Give recently seen sources a second chance. */
+      slot.referenced = false;
+      continue;
+    }
+
+    index_.erase(slot.key);
+    evictions_++;
+
+    return slot_idx;
+  }
+}
+
+}  // namespace gateway
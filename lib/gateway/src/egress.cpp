@@ -0,0 +1,940 @@
+#include "gateway/egress.h"
+
+#include "microloop/event_loop.h"
+#include "microloop/kernel_exception.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <iterator>
+#include <poll.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <utility>
+
+namespace gateway
+{
+
+namespace
+{
+
+/* The largest number of frames written by a single system call. */
+constexpr std::size_t MAX_IOV = 64;
+
+iovec to_iovec(const SharedFrame &frame)
+{
+  return iovec{const_cast<void *>(frame->data()), frame->size()};
+}
+
+}  // namespace
+
+/**
+ * \brief Thread performing the writes for the connections it owns.
+ *
+ * Connections are known to the reactor by a descriptor of their socket it is handed along with
+ * their frames, and closes once told to. The frames a socket does not accept right away wait in a
+ * queue of the connection, written again once the socket becomes writable. The bytes written are
+ * reported back through a second queue, by the serial of their connection.
+ *
+ * Frames are never released by the reactor: those it is done with are handed back through a third
+ * queue, so that their buffers return to the pool of the event loop thread, which serializes them.
+ */
+class Egress::Reactor
+{
+public:
+  static constexpr std::size_t QUEUE_CAPACITY = 1 << 16;
+  static constexpr std::size_t REPORTS_CAPACITY = 1 << 12;
+  static constexpr std::size_t RETIRED_CAPACITY = 1 << 16;
+
+  /**
+   * \param progress Notified once the reactor reported written bytes, or made room in its queue
+   * after it was found full.
+   */
+  explicit Reactor(net_utils::Notifier &progress) :
+      queue_{QUEUE_CAPACITY},
+      reports_{REPORTS_CAPACITY},
+      retired_{RETIRED_CAPACITY},
+      wakeup_fd_{eventfd(0, EFD_CLOEXEC)},
+      progress_{progress},
+      writable_{[this](std::uint32_t fd) { on_writable(static_cast<int>(fd)); }}
+  {
+    if (wakeup_fd_ == -1)
+    {
+      throw microloop::KernelException{errno};
+    }
+
+    thread_ = std::thread{&Reactor::run, this};
+  }
+
+  ~Reactor()
+  {
+    stopping_ = true;
+    wake();
+
+    thread_.join();
+    close(wakeup_fd_);
+
+    /* Descriptors handed back after the thread stopped are closed here. */
+    OutboundFrame item;
+    while (queue_.try_pop(item))
+    {
+      if (!item.frame)
+      {
+        close(item.fd);
+      }
+    }
+  }
+
+  /**
+   * \brief Submit a frame to be written to the reactor descriptor \p fd, of the connection
+   * \p serial.
+   * \returns Whether the frame was taken. If the queue is full, the frame is left to the caller,
+   * who gets notified once there is room.
+   */
+  bool submit(int fd, std::uint64_t serial, SharedFrame &frame)
+  {
+    OutboundFrame item{fd, serial, std::move(frame)};
+    if (!push(item))
+    {
+      frame = std::move(item.frame);
+      return false;
+    }
+
+    return true;
+  }
+
+  /**
+   * \brief Hand the reactor descriptor \p fd back, to be closed once the frames submitted for it
+   * are written as far as the socket accepts them.
+   * \returns Whether the descriptor was taken. If the queue is full, the descriptor is left to the
+   * caller, who gets notified once there is room.
+   */
+  bool detach(int fd)
+  {
+    OutboundFrame item{fd, 0, nullptr};
+    return push(item);
+  }
+
+  /**
+   * \brief Invoke \p callback with the serial of a connection and the bytes written to it, per
+   * report. The frames the reactor is done with are dropped on the calling thread.
+   */
+  template <class Callback>
+  void reported(Callback &&callback)
+  {
+    Report report;
+    while (reports_.try_pop(report))
+    {
+      callback(report.serial, report.bytes);
+    }
+
+    SharedFrame frame;
+    while (retired_.try_pop(frame))
+    {
+      frame.reset();
+    }
+
+    /* Reports left behind for the lack of room are pushed again by the reactor. */
+    if (reports_full_.exchange(false))
+    {
+      wake();
+    }
+  }
+
+private:
+  /* A frame to be written to a reactor descriptor, or the descriptor handed back if empty. */
+  struct OutboundFrame
+  {
+    int fd;
+    std::uint64_t serial;
+    SharedFrame frame;
+  };
+
+  /* Bytes written to a connection, reported back to the event loop thread. */
+  struct Report
+  {
+    std::uint64_t serial;
+    std::size_t bytes;
+  };
+
+  /* The frames of a connection not written yet. */
+  struct Outbound
+  {
+    std::uint64_t serial = 0;
+    std::deque<Pending> queue;
+    std::size_t offset = 0;
+
+    /* Bytes written, not reported yet. */
+    std::size_t unreported = 0;
+
+    /* Whether the socket did not accept more bytes, so it is watched for EPOLLOUT. */
+    bool blocked = false;
+
+    /* Whether the connection is broken, so its frames are dropped until it is closed. */
+    bool broken = false;
+  };
+
+  bool push(OutboundFrame &item)
+  {
+    if (!queue_.try_push(std::move(item)))
+    {
+      /* Announce the full queue before trying again, so the reactor tells once it makes room. */
+      full_.store(true);
+      if (!queue_.try_push(std::move(item)))
+      {
+        return false;
+      }
+    }
+
+    /* Only issue a wakeup if the reactor went to sleep on an empty queue. */
+    if (sleeping_.load() && sleeping_.exchange(false))
+    {
+      wake();
+    }
+
+    return true;
+  }
+
+  void wake()
+  {
+    std::uint64_t one = 1;
+    ::write(wakeup_fd_, &one, sizeof(one));
+  }
+
+  /* Move the submitted frames to the queues of their connections, then write those. */
+  void drain()
+  {
+    OutboundFrame item;
+    std::size_t popped = 0;
+
+    while (popped < QUEUE_CAPACITY && queue_.try_pop(item))
+    {
+      popped++;
+
+      if (!item.frame)
+      {
+        close_conn(item.fd);
+        continue;
+      }
+
+      auto &out = conns_[item.fd];
+      if (out.queue.empty() && !out.blocked)
+      {
+        ready_.push_back(item.fd);
+      }
+
+      out.serial = item.serial;
+      out.queue.push_back(Pending{std::move(item.frame), false});
+    }
+
+    if (popped != 0 && full_.exchange(false))
+    {
+      progress_.notify();
+    }
+
+    for (auto fd : ready_)
+    {
+      if (auto it = conns_.find(fd); it != conns_.end())
+      {
+        write(fd, it->second);
+      }
+    }
+
+    ready_.clear();
+  }
+
+  void write(int fd, Outbound &out)
+  {
+    if (out.broken)
+    {
+      retire(out.queue);
+      return;
+    }
+
+    Stats stats;
+    std::size_t written = 0;
+
+    auto status = write_queue(fd, out.queue, out.offset, stats, written, &unretired_);
+    if (written != 0)
+    {
+      if (out.unreported == 0)
+      {
+        unreported_.push_back(fd);
+      }
+
+      out.unreported += written;
+    }
+
+    switch (status)
+    {
+    case WriteStatus::WRITTEN:
+      break;
+    case WriteStatus::BLOCKED:
+      out.blocked = true;
+      writable_.watch(fd);
+      break;
+    case WriteStatus::BROKEN:
+      /* The event loop detects the broken connection on its own, and closes it. */
+      out.broken = true;
+      retire(out.queue);
+      break;
+    }
+  }
+
+  void on_writable(int fd)
+  {
+    if (auto it = conns_.find(fd); it != conns_.end())
+    {
+      it->second.blocked = false;
+      write(fd, it->second);
+    }
+  }
+
+  /* Keep the frames of \p queue to be handed back, and empty it. */
+  void retire(std::deque<Pending> &queue)
+  {
+    for (auto &pending : queue)
+    {
+      unretired_.push_back(std::move(pending.frame));
+    }
+
+    queue.clear();
+  }
+
+  /*
+   * Report the bytes written since the last time, and hand back the frames done with, as far as
+   * there is room in the queues.
+   */
+  void report()
+  {
+    auto pushed = false;
+    auto it = std::remove_if(unreported_.begin(), unreported_.end(), [&](int fd) {
+      auto conn = conns_.find(fd);
+      if (conn == conns_.end())
+      {
+        return true;
+      }
+
+      /* Announce the full queue before trying again, as done for submitted frames. */
+      auto &out = conn->second;
+      Report report{out.serial, out.unreported};
+      if (!reports_.try_push(std::move(report)))
+      {
+        reports_full_.store(true);
+        if (!reports_.try_push(std::move(report)))
+        {
+          return false;
+        }
+      }
+
+      pushed = true;
+      out.unreported = 0;
+      return true;
+    });
+
+    unreported_.erase(it, unreported_.end());
+
+    std::size_t retired = 0;
+    for (; retired < unretired_.size(); retired++)
+    {
+      if (!retired_.try_push(std::move(unretired_[retired])))
+      {
+        reports_full_.store(true);
+        if (!retired_.try_push(std::move(unretired_[retired])))
+        {
+          break;
+        }
+      }
+
+      pushed = true;
+    }
+
+    unretired_.erase(unretired_.begin(), unretired_.begin() + retired);
+
+    if (pushed)
+    {
+      progress_.notify();
+    }
+  }
+
+  /* Write what the socket accepts right away of the frames left, then close the descriptor. */
+  void close_conn(int fd)
+  {
+    if (auto it = conns_.find(fd); it != conns_.end())
+    {
+      auto &out = it->second;
+      if (!out.blocked)
+      {
+        write(fd, out);
+      }
+
+      writable_.unwatch(fd);
+      retire(out.queue);
+      conns_.erase(it);
+    }
+
+    close(fd);
+  }
+
+  void run()
+  {
+    /* Signals are handled by the event loop thread. */
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, nullptr);
+
+    pollfd fds[] = {
+        {wakeup_fd_, POLLIN, 0},
+        {static_cast<int>(writable_.get_fd()), POLLIN, 0},
+    };
+
+    while (!stopping_)
+    {
+      drain();
+      report();
+
+      /* Check the queue again after announcing the sleep, so no submitted frame is missed. */
+      sleeping_.store(true);
+      if (!queue_.empty() || stopping_)
+      {
+        sleeping_.store(false);
+        continue;
+      }
+
+      /* Sleep until frames are submitted, or blocked sockets become writable. */
+      if (poll(fds, 2, -1) == -1)
+      {
+        sleeping_.store(false);
+        continue;
+      }
+
+      sleeping_.store(false);
+
+      if (fds[0].revents & POLLIN)
+      {
+        std::uint64_t count;
+        read(wakeup_fd_, &count, sizeof(count));
+      }
+
+      if (fds[1].revents & POLLIN)
+      {
+        writable_.run_callback();
+      }
+    }
+  }
+
+private:
+  SpscRing<OutboundFrame> queue_;
+  SpscRing<Report> reports_;
+  SpscRing<SharedFrame> retired_;
+  int wakeup_fd_;
+  net_utils::Notifier &progress_;
+
+  std::atomic<bool> stopping_{false};
+  std::atomic<bool> sleeping_{false};
+  std::atomic<bool> full_{false};
+  std::atomic<bool> reports_full_{false};
+
+  /* Only used by the reactor thread. */
+  std::unordered_map<int, Outbound> conns_;
+  std::vector<int> ready_;
+
+  /* Connections with bytes written, not reported yet. */
+  std::vector<int> unreported_;
+
+  /* Frames done with, not handed back yet. */
+  std::vector<SharedFrame> unretired_;
+  net_utils::WritableWatcher writable_;
+
+  std::thread thread_;
+};
+
+Egress::Egress(const Config &config) :
+    coalesce_bytes_{config.coalesce_bytes},
+    coalesce_delay_{config.coalesce_us},
+    queue_high_{std::max(config.queue_high, config.coalesce_bytes)},
+    queue_low_{std::min(config.queue_low, queue_high_)}
+{
+  using microloop::EventLoop;
+
+  if (config.tcp_reactors != 0)
+  {
+    reactor_progress_ = new net_utils::Notifier{[this] { on_reactor_progress(); }};
+    EventLoop::instance().add_event_source(reactor_progress_);
+  }
+
+  for (std::size_t i = 0; i < config.tcp_reactors; i++)
+  {
+    reactors_.push_back(std::make_unique<Reactor>(*reactor_progress_));
+  }
+
+  if (coalesce_bytes_ != 0 && coalesce_delay_ != std::chrono::microseconds::zero())
+  {
+    flush_timer_ = new net_utils::Timer{[this] { flush(); }};
+    EventLoop::instance().add_event_source(flush_timer_);
+  }
+
+  if (reactors_.empty())
+  {
+    writable_ = new net_utils::WritableWatcher{[this](std::uint32_t fd) { on_writable(fd); }};
+    EventLoop::instance().add_event_source(writable_);
+  }
+}
+
+Egress::~Egress()
+{
+  reactors_.clear();
+
+  /* The reactors are gone, so the descriptors they were not handed back yet are closed here. */
+  for (auto &[fd, c] : conns_)
+  {
+    if (c.reactor_fd != -1)
+    {
+      close(c.reactor_fd);
+    }
+  }
+
+  for (auto reactor_fd : detaching_)
+  {
+    close(reactor_fd);
+  }
+}
+
+bool Egress::send(microloop::net::TcpServer::PeerConnection &conn,
+    SharedFrame frame,
+    bool droppable)
+{
+  auto fd = conn.fd();
+  auto &c = conns_[fd];
+
+  if (coalesce_bytes_ != 0 && c.unflushed == 0)
+  {
+    /* The flush delay starts with the first frame waiting for any of the connections. */
+    if (pending_.empty() && flush_timer_)
+    {
+      flush_timer_->arm(coalesce_delay_);
+    }
+
+    pending_.push_back(fd);
+  }
+
+  c.queued += frame->size();
+  c.unflushed += frame->size();
+  c.queue.push_back(Pending{std::move(frame), droppable});
+
+  c.stats.high_water = std::max(c.stats.high_water, c.queued + c.in_flight);
+
+  /* When coalescing, frames are written once enough of them are waiting, or when flushed. */
+  auto sent = (coalesce_bytes_ != 0 && c.unflushed < coalesce_bytes_) || write(fd, c);
+  update(fd, c);
+
+  return sent;
+}
+
+void Egress::quiesce(const microloop::net::TcpServer::PeerConnection &conn)
+{
+  if (auto it = conns_.find(conn.fd()); it != conns_.end())
+  {
+    write(conn.fd(), it->second);
+  }
+}
+
+void Egress::detach(const microloop::net::TcpServer::PeerConnection &conn)
+{
+  if (writable_)
+  {
+    writable_->unwatch(conn.fd());
+  }
+
+  auto it = conns_.find(conn.fd());
+  if (it == conns_.end())
+  {
+    return;
+  }
+
+  /* The frames still waiting for room in the queue of the reactor are dropped along. */
+  auto reactor_fd = it->second.reactor_fd;
+  if (reactor_fd != -1 && !owner(reactor_fd).detach(reactor_fd))
+  {
+    detaching_.push_back(reactor_fd);
+  }
+
+  serials_.erase(it->second.serial);
+
+  conns_.erase(it);
+}
+
+void Egress::on_tick_end()
+{
+  if (!flush_timer_)
+  {
+    flush();
+  }
+
+  notify_drained();
+}
+
+bool Egress::congested(const microloop::net::TcpServer::PeerConnection &conn) const
+{
+  auto it = conns_.find(conn.fd());
+  return it != conns_.end() && it->second.congested;
+}
+
+bool Egress::blocked(const microloop::net::TcpServer::PeerConnection &conn) const
+{
+  auto it = conns_.find(conn.fd());
+  return it != conns_.end() && it->second.blocked;
+}
+
+bool Egress::idle(const microloop::net::TcpServer::PeerConnection &conn) const
+{
+  auto it = conns_.find(conn.fd());
+  return it == conns_.end() || (it->second.queue.empty() && it->second.in_flight == 0);
+}
+
+void Egress::drop_oldest(const microloop::net::TcpServer::PeerConnection &conn)
+{
+  auto c_it = conns_.find(conn.fd());
+  if (c_it == conns_.end())
+  {
+    return;
+  }
+
+  auto &c = c_it->second;
+
+  /* A frame written in part has to be written entirely, so the stream stays decodable. */
+  auto it = c.offset != 0 ? std::next(c.queue.begin()) : c.queue.begin();
+
+  while (c.queued + c.in_flight > queue_low_ && it != c.queue.end())
+  {
+    if (!it->droppable)
+    {
+      ++it;
+      continue;
+    }
+
+    c.queued -= it->frame->size();
+    c.stats.dropped++;
+    it = c.queue.erase(it);
+  }
+
+  c.unflushed = std::min(c.unflushed, c.queued);
+  update(conn.fd(), c);
+}
+
+Egress::Stats Egress::stats(const microloop::net::TcpServer::PeerConnection &conn) const
+{
+  auto it = conns_.find(conn.fd());
+  return it != conns_.end() ? it->second.stats : Stats{};
+}
+
+Egress::WriteStatus Egress::write_queue(int fd,
+    std::deque<Pending> &queue,
+    std::size_t &offset,
+    Stats &stats,
+    std::size_t &written,
+    std::vector<SharedFrame> *retired)
+{
+  iovec iov[MAX_IOV];
+
+  while (!queue.empty())
+  {
+    auto count = std::min(queue.size(), MAX_IOV);
+    std::transform(queue.begin(), queue.begin() + count, iov,
+        [](auto &&pending) { return to_iovec(pending.frame); });
+
+    iov[0].iov_base = static_cast<std::uint8_t *>(iov[0].iov_base) + offset;
+    iov[0].iov_len -= offset;
+
+    msghdr msg{};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+
+    ssize_t nsent = ::sendmsg(fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (nsent == -1)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+        return WriteStatus::BLOCKED;
+      }
+
+      return WriteStatus::BROKEN;
+    }
+
+    stats.writes++;
+    written += nsent;
+
+    /* Pop the frames written entirely, then remember the written part of the next one. */
+    std::size_t left = offset + nsent;
+    while (!queue.empty() && left >= queue.front().frame->size())
+    {
+      left -= queue.front().frame->size();
+      if (retired)
+      {
+        retired->push_back(std::move(queue.front().frame));
+      }
+
+      queue.pop_front();
+      stats.frames++;
+    }
+
+    offset = left;
+  }
+
+  return WriteStatus::WRITTEN;
+}
+
+Egress::Reactor &Egress::owner(int reactor_fd)
+{
+  return *reactors_[reactor_fd % reactors_.size()];
+}
+
+bool Egress::write(std::uint32_t fd, Connection &c)
+{
+  c.unflushed = 0;
+
+  if (!reactors_.empty())
+  {
+    return submit(fd, c);
+  }
+
+  /* A blocked connection is written again once its socket becomes writable. */
+  if (c.blocked)
+  {
+    return true;
+  }
+
+  std::size_t written = 0;
+  auto status = write_queue(fd, c.queue, c.offset, c.stats, written);
+  c.queued -= written;
+
+  switch (status)
+  {
+  case WriteStatus::WRITTEN:
+    return true;
+  case WriteStatus::BLOCKED:
+    c.blocked = true;
+    writable_->watch(fd);
+    return true;
+  case WriteStatus::BROKEN:
+    break;
+  }
+
+  /* The connection is broken, and is about to be closed by the event loop. */
+  c.queue.clear();
+  c.queued = 0;
+  c.offset = 0;
+
+  return false;
+}
+
+bool Egress::submit(std::uint32_t fd, Connection &c)
+{
+  if (c.queue.empty())
+  {
+    return true;
+  }
+
+  if (c.reactor_fd == -1)
+  {
+    c.reactor_fd = fcntl(static_cast<int>(fd), F_DUPFD_CLOEXEC, 0);
+    if (c.reactor_fd == -1)
+    {
+      c.queue.clear();
+      c.queued = 0;
+
+      return false;
+    }
+
+    c.serial = ++next_serial_;
+    serials_.emplace(c.serial, fd);
+  }
+
+  /* The reactor writes the frames at once, as they are queued in a row. */
+  auto &reactor = owner(c.reactor_fd);
+  auto submitted = c.stats.frames;
+
+  /*
+   * The reactor only gets up to the low watermark of bytes, so the overflow policy can still act on
+   * the frames of a slow subscriber.
+   */
+  while (!c.queue.empty() && (c.in_flight == 0 || c.in_flight < queue_low_))
+  {
+    auto size = c.queue.front().frame->size();
+    if (!reactor.submit(c.reactor_fd, c.serial, c.queue.front().frame))
+    {
+      /* The frames left wait for the reactor to make room, without blocking the event loop. */
+      if (!c.stalled)
+      {
+        c.stalled = true;
+        c.stats.stalls++;
+        stalled_.push_back(fd);
+      }
+
+      break;
+    }
+
+    c.queued -= size;
+    c.in_flight += size;
+    c.queue.pop_front();
+    c.stats.frames++;
+  }
+
+  if (c.stats.frames != submitted)
+  {
+    c.stats.writes++;
+  }
+
+  c.blocked = !c.queue.empty();
+
+  return true;
+}
+
+void Egress::update(std::uint32_t fd, Connection &c)
+{
+  /* Bytes in flight count as queued, until their reactor reports them as written. */
+  auto queued = c.queued + c.in_flight;
+
+  if (!c.congested && queued > queue_high_)
+  {
+    c.congested = true;
+  }
+  else if (c.congested && queued <= queue_low_)
+  {
+    c.congested = false;
+    drained_.push_back(fd);
+  }
+}
+
+void Egress::on_writable(std::uint32_t fd)
+{
+  auto it = conns_.find(fd);
+  if (it == conns_.end())
+  {
+    return;
+  }
+
+  auto &c = it->second;
+  c.blocked = false;
+
+  write(fd, c);
+  update(fd, c);
+
+  /* The socket keeps up again, unless it blocked once more. */
+  if (!c.blocked && std::find(drained_.begin(), drained_.end(), fd) == drained_.end())
+  {
+    drained_.push_back(fd);
+  }
+
+  notify_drained();
+}
+
+void Egress::on_reactor_progress()
+{
+  for (auto &reactor : reactors_)
+  {
+    reactor->reported(
+        [this](std::uint64_t serial, std::size_t bytes) { on_reactor_written(serial, bytes); });
+  }
+
+  std::vector<int> detaching;
+  detaching.swap(detaching_);
+
+  for (auto reactor_fd : detaching)
+  {
+    if (!owner(reactor_fd).detach(reactor_fd))
+    {
+      detaching_.push_back(reactor_fd);
+    }
+  }
+
+  std::vector<std::uint32_t> stalled;
+  stalled.swap(stalled_);
+
+  for (auto fd : stalled)
+  {
+    auto it = conns_.find(fd);
+    if (it == conns_.end())
+    {
+      continue;
+    }
+
+    auto &c = it->second;
+    c.stalled = false;
+
+    resubmit(fd, c);
+  }
+
+  notify_drained();
+}
+
+void Egress::on_reactor_written(std::uint64_t serial, std::size_t bytes)
+{
+  /* Reports about connections detached meanwhile are left out. */
+  auto serial_it = serials_.find(serial);
+  if (serial_it == serials_.end())
+  {
+    return;
+  }
+
+  auto fd = serial_it->second;
+  if (auto it = conns_.find(fd); it != conns_.end())
+  {
+    it->second.in_flight -= bytes;
+    resubmit(fd, it->second);
+  }
+}
+
+void Egress::resubmit(std::uint32_t fd, Connection &c)
+{
+  auto blocked = c.blocked;
+
+  submit(fd, c);
+  update(fd, c);
+
+  /* The queue was handed to the reactor entirely, so the reactor keeps up again. */
+  if (blocked && !c.blocked && std::find(drained_.begin(), drained_.end(), fd) == drained_.end())
+  {
+    drained_.push_back(fd);
+  }
+}
+
+void Egress::notify_drained()
+{
+  /* The callbacks may send more frames, and drain other connections meanwhile. */
+  std::vector<std::uint32_t> drained;
+  drained.swap(drained_);
+
+  for (auto fd : drained)
+  {
+    if (on_drained_ && conns_.count(fd))
+    {
+      on_drained_(fd);
+    }
+  }
+}
+
+void Egress::flush()
+{
+  /* Connections detached, or flushed for reaching the size threshold, have nothing left. */
+  for (auto fd : pending_)
+  {
+    if (auto it = conns_.find(fd); it != conns_.end() && it->second.unflushed != 0)
+    {
+      write(fd, it->second);
+      update(fd, it->second);
+    }
+  }
+
+  pending_.clear();
+}
+
+}  // namespace gateway
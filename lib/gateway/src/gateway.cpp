@@ -1,42 +1,279 @@
 #include "gateway/gateway.h"
 
-#include <variant>
+#include "gateway/store_forward_log.h"
+#include "microloop/event_loop.h"
+#include "net_utils/buffer_pool.h"
+#include "net_utils/timer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <ostream>
 
 namespace gateway
 {
 
+Gateway::Gateway(int port, const Config &config) :
+    overflow_{config.overflow},
+    egress_{config},
+    store_forward_{make_store_forward(config)},
+    last_values_{config.last_value_bytes},
+    input_endpoint_{port, config.udp_batch_size, config.udp_shards, config.udp_handoff},
+    subscriber_endpoint_{port, subscribers_, egress_, *store_forward_, last_values_},
+    sources_{config.device_sources}
+{
+  using microloop::EventLoop;
+
+  /* Pipe device data input into the subscriber endpoint */
+  input_endpoint_.subscribe(&Gateway::on_device_input, this);
+
+  egress_.on_drained([this](std::uint32_t fd) { on_drained(fd); });
+
+  /* The last value cache needs every message, whether its topic has subscribers or not. */
+  if (config.last_value_bytes == 0)
+  {
+    input_endpoint_.set_topic_filter(&subscribers_.topic_filter());
+  }
+
+  if (!config.sf_dir.empty())
+  {
+    std::chrono::milliseconds interval{std::max<std::size_t>(config.sf_commit_ms, 1)};
+
+    auto commit_timer = new net_utils::Timer{[this] { store_forward_->commit(); }};
+    commit_timer->arm(interval, interval);
+    EventLoop::instance().add_event_source(commit_timer);
+  }
+}
+
+std::unique_ptr<StoreForward> Gateway::make_store_forward(const Config &config)
+{
+  if (config.sf_dir.empty())
+  {
+    return std::make_unique<MemoryStoreForward>();
+  }
+
+  return std::make_unique<StoreForwardLog>(config.sf_dir);
+}
+
 void Gateway::on_device_input(const net_utils::AddressWrapper &source,
-    const commons::device_messages::GenericDeviceMessage &generic_msg)
+    const commons::device_messages::DeviceMessageView &msg)
+{
+  using commons::subscriber_messages::DeviceNotification;
+  using commons::subscriber_messages::PROTOCOL_LATEST;
+  using commons::subscriber_messages::PROTOCOL_V1;
+  using commons::subscriber_messages::PROTOCOL_V2;
+  using commons::subscriber_messages::PROTOCOL_V3;
+
+  auto &device = sources_.lookup(source);
+  device.datagrams++;
+  device.bytes += msg.serialized_size();
+
+  last_values_.update(device, msg);
+
+  subscribers_.match(msg.topic(), matched_);
+  if (matched_.empty())
+  {
+    return;
+  }
+
+  /* Topic of the notification in the dictionary, looked up for the first version 3 client. */
+  const TopicDictionary::Topic *topic = nullptr;
+
+  /* Topic of the notification among the conflated topics, looked up for the first slot. */
+  conflated_topic_ = InternTable::NONE;
+
+  /* The notification is serialized at most once for every protocol version in use. */
+  SharedFrame frames[PROTOCOL_LATEST + 1];
+  auto frame_for = [&](std::uint8_t version) -> const SharedFrame & {
+    auto &frame = frames[version];
+    if (frame)
+    {
+      return frame;
+    }
+
+    switch (version)
+    {
+    case PROTOCOL_V1:
+      frame = make_shared_frame(DeviceNotification::serialize(device.address_str(), msg));
+      break;
+    case PROTOCOL_V2:
+      frame = make_shared_frame(DeviceNotification::serialize_v2(device.address_bin, msg));
+      break;
+    default:
+      frame = make_shared_frame(
+          DeviceNotification::serialize_tagged(device.address_bin, topic->id, msg));
+    }
+
+    return frame;
+  };
+
+  for (auto subscriber : matched_)
+  {
+    auto [client, conflate] = *subscriber;
+
+    if (!client->active() || client->replaying)
+    {
+      /* Stored frames use the version 1 encoding, and are encoded again upon delivery. */
+      store_forward_->append(*client, msg.topic(), frame_for(PROTOCOL_V1));
+
+      continue;
+    }
+
+    /* Only the latest notification is kept until the socket keeps up, then sent in order. */
+    if (conflate && (egress_.blocked(*client->raw_conn) || !client->conflated_topics.empty()))
+    {
+      subscribers_.conflate(*client, msg.topic(), conflated_topic_, frame_for(PROTOCOL_V1));
+      continue;
+    }
+
+    if (diverted(*client) && !on_overflow(*client, msg.topic(), frame_for(PROTOCOL_V1)))
+    {
+      continue;
+    }
+
+    if (client->protocol == PROTOCOL_V3)
+    {
+      if (!topic)
+      {
+        topic = &topic_ids_.lookup(msg.topic());
+      }
+
+      if (client->define_topic(topic->id, topic->binding))
+      {
+        egress_.send(*client->raw_conn, topic->definition);
+      }
+    }
+
+    egress_.send(*client->raw_conn, frame_for(client->protocol), true);
+  }
+
+  /* Disconnecting changes the subscriptions, so it waits until the message is routed. */
+  for (auto &client_id : slow_clients_)
+  {
+    if (auto client = subscribers_.named(client_id, true); client && client->active())
+    {
+      subscriber_endpoint_.drop(*client);
+    }
+  }
+
+  slow_clients_.clear();
+}
+
+bool Gateway::diverted(const SubscriberConnection &client) const
+{
+  /* Once diverted, notifications keep being diverted until the older ones are sent, in order. */
+  auto conflating = overflow_ == OverflowPolicy::CONFLATE && !client.conflated_topics.empty();
+  return client.spilled || conflating || egress_.congested(*client.raw_conn);
+}
+
+bool Gateway::on_overflow(SubscriberConnection &client,
+    std::string_view topic,
+    const SharedFrame &frame)
+{
+  switch (overflow_)
+  {
+  case OverflowPolicy::DROP_OLDEST:
+    egress_.drop_oldest(*client.raw_conn);
+    return true;
+  case OverflowPolicy::CONFLATE:
+    subscribers_.conflate(client, topic, conflated_topic_, frame);
+    return false;
+  case OverflowPolicy::SPILL:
+    store_forward_->append(client, topic, frame);
+    client.spilled = true;
+    return false;
+  case OverflowPolicy::DISCONNECT:
+    slow_clients_.push_back(client.client_id);
+    return false;
+  }
+
+  return false;
+}
+
+void Gateway::on_drained(std::uint32_t fd)
 {
   using commons::subscriber_messages::DeviceNotification;
+  using commons::subscriber_messages::PROTOCOL_V1;
 
-  auto &subscriptions = subscribers_.subscriptions();
+  auto client = subscribers_.with_fd(fd);
+  if (!client)
+  {
+    return;
+  }
 
-  std::visit(
-      [&](auto &&msg) {
-        DeviceNotification notif{source.str(), msg};
+  auto &conn = *client->raw_conn;
 
-        for (auto it = subscriptions.cbegin(); it != subscriptions.cend(); ++it)
-        {
-          auto &[client_id, s] = *it;
-          auto client = subscribers_.named(client_id, true);
+  if (client->spilled || client->replaying)
+  {
+    /* The replay stops once the connection is congested again, keeping the rest for later. */
+    store_forward_->replay(*client, egress_);
+    client->spilled = egress_.congested(conn);
+  }
 
-          if (s.topic != msg.topic)
-          {
-            continue;
-          }
+  /* Slots are drained at the rate the socket accepts them, the rest waiting for the next drain. */
+  while (!client->conflated_topics.empty() && !egress_.congested(conn) && !egress_.blocked(conn))
+  {
+    auto frame = subscribers_.take_conflated(*client);
+    if (client->protocol == PROTOCOL_V1)
+    {
+      egress_.send(conn, frame, true);
+      continue;
+    }
 
-          if (!client->active())
-          {
-            client->pending_messages.push(notif);
+    auto encoded = DeviceNotification::transcode(frame->data(), frame->size(), client->protocol);
+    egress_.send(conn, make_shared_frame(std::move(encoded)), true);
+  }
+}
 
-            continue;
-          }
+void Gateway::on_tick_end()
+{
+  egress_.on_tick_end();
+}
+
+void Gateway::print_stats(std::ostream &os) const
+{
+  auto pool = net_utils::BufferPool::total_stats();
+
+  os << "buffer pool: " << pool.hits << " hits, " << pool.misses << " misses, " << pool.overflows
+     << " overflows, " << pool.cached << " cached, " << pool.high_water << " high water\n";
+
+  os << "device sources: " << sources_.size() << " tracked, " << sources_.evictions()
+     << " evictions\n";
+
+  os << "input endpoint: " << input_endpoint_.discarded()
+     << " datagrams discarded without subscribers, " << input_endpoint_.handoff_dropped()
+     << " dropped on hand-off\n";
+
+  os << "subscribers: " << subscribers_.client_count() << " clients, "
+     << subscribers_.topic_count() << " topics\n";
 
-          client->raw_conn->send(notif.serialize());
-        }
-      },
-      generic_msg);
+  os << "topic dictionary: " << topic_ids_.size() << " topics, " << topic_ids_.reclaimed()
+     << " identifiers reclaimed\n";
+
+  os << "last value cache: " << last_values_.size() << " topics, " << last_values_.bytes()
+     << " bytes, " << last_values_.evictions() << " evictions\n";
+
+  subscribers_.for_each_connection([&](const SubscriberConnection &client) {
+    if (!client.active())
+    {
+      return;
+    }
+
+    auto egress = egress_.stats(*client.raw_conn);
+    auto factor = egress.writes ? static_cast<double>(egress.frames) / egress.writes : 0.0;
+
+    os << "egress \"" << client.client_id << "\": " << egress.frames << " frames, "
+       << egress.writes << " writes, " << factor << " frames per write, " << egress.dropped
+       << " dropped, " << egress.high_water << " bytes high water\n";
+  });
+}
+
+void Gateway::print_sources(std::ostream &os) const
+{
+  sources_.for_each([&os](auto &&device) {
+    os << device.address_str() << " - " << device.datagrams << " datagrams, " << device.bytes
+       << " bytes\n";
+  });
 }
 
 }  // namespace gateway
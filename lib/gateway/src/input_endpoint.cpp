@@ -1,13 +1,194 @@
 #include "gateway/input_endpoint.h"
 
+#include "microloop/event_loop.h"
+#include "net_utils/buffer_pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
 namespace gateway::endpoint
 {
 
-void InputEndpoint::on_data(const net_utils::AddressWrapper &source, const microloop::Buffer &buf)
+InputEndpoint::InputEndpoint(std::uint16_t port,
+    std::size_t batch_size,
+    std::size_t shards,
+    std::size_t handoff_capacity) :
+    handoff_capacity_{handoff_capacity}
+{
+  using microloop::EventLoop;
+  using namespace std::placeholders;
+
+  if (shards == 0)
+  {
+    server_ = std::make_unique<net_utils::UdpServer>(port, batch_size);
+    server_->set_batch_callback(&InputEndpoint::on_batch, this);
+
+    return;
+  }
+
+  for (std::size_t i = 0; i < shards; i++)
+  {
+    handoffs_.push_back(std::make_unique<Handoff>());
+  }
+
+  handoff_notifier_ = new net_utils::Notifier{std::bind(&InputEndpoint::on_handoff, this)};
+  EventLoop::instance().add_event_source(handoff_notifier_);
+
+  shards_ = std::make_unique<net_utils::UdpShards>(
+      port, shards, batch_size, std::bind(&InputEndpoint::on_shard_batch, this, _1, _2));
+}
+
+void InputEndpoint::on_batch(const net_utils::DatagramBatch &batch)
 {
-  auto msg = commons::device_messages::from_buffer(buf);
+  using commons::device_messages::DeviceMessageView;
+
+  for (std::size_t i = 0; i < batch.size(); i++)
+  {
+    auto datagram = batch[i];
+
+    if (!wanted(datagram))
+    {
+      continue;
+    }
+
+    if (auto msg = DeviceMessageView::parse(datagram.data, datagram.size))
+    {
+      subscriber_(datagram.source, *msg);
+    }
+  }
+}
+
+bool InputEndpoint::wanted(const net_utils::Datagram &datagram)
+{
+  using commons::device_messages::DeviceMessageView;
+
+  auto filter = filter_.load(std::memory_order_acquire);
+  if (!filter)
+  {
+    return true;
+  }
+
+  /* Datagrams too short to hold a topic are left to be rejected by the parser. */
+  auto topic = DeviceMessageView::peek_topic(datagram.data, datagram.size);
+  if (!topic || filter->may_contain(*topic))
+  {
+    return true;
+  }
+
+  discarded_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+void InputEndpoint::on_shard_batch(std::size_t shard, const net_utils::DatagramBatch &batch)
+{
+  using commons::device_messages::DeviceMessageView;
+
+  auto &handoff = *handoffs_[shard];
+  auto &pool = net_utils::BufferPool::local();
+
+  /* The buffers of the messages dispatched since the previous batch come back to this pool. */
+  {
+    std::lock_guard<std::mutex> lock{handoff.mutex};
+    handoff.reclaimed.swap(handoff.recycled);
+  }
+
+  for (auto &buf : handoff.reclaimed)
+  {
+    pool.release(std::move(buf));
+  }
+
+  handoff.reclaimed.clear();
+
+  auto &received = handoff.received;
+  for (std::size_t i = 0; i < batch.size(); i++)
+  {
+    auto datagram = batch[i];
+    if (!wanted(datagram) || !DeviceMessageView::parse(datagram.data, datagram.size))
+    {
+      continue;
+    }
+
+    /* The slab is reused by the next receive, so the datagram must be copied out. */
+    auto buf = pool.acquire(datagram.size);
+    std::memcpy(buf.data(), datagram.data, datagram.size);
+
+    received.emplace_back(datagram.source, std::move(buf));
+  }
+
+  if (received.empty())
+  {
+    return;
+  }
+
+  bool was_empty;
+  std::size_t accepted;
+  {
+    std::lock_guard<std::mutex> lock{handoff.mutex};
+
+    auto &queue = handoff.queue;
+    auto room = handoff_capacity_ - std::min(handoff_capacity_, queue.size());
+
+    was_empty = queue.empty();
+    accepted = std::min(received.size(), room);
+
+    auto first = std::make_move_iterator(received.begin());
+    queue.insert(queue.end(), first, first + accepted);
+  }
+
+  /* The messages past the capacity of the queue are dropped, and their buffers kept by the pool. */
+  if (accepted != received.size())
+  {
+    handoff_dropped_.fetch_add(received.size() - accepted, std::memory_order_relaxed);
+
+    for (auto it = received.begin() + accepted; it != received.end(); it++)
+    {
+      pool.release(std::move(it->second));
+    }
+  }
+
+  received.clear();
+
+  /* A single wakeup is enough until the event loop thread drains the queue. */
+  if (was_empty && accepted != 0)
+  {
+    handoff_notifier_->notify();
+  }
+}
+
+void InputEndpoint::on_handoff()
+{
+  using commons::device_messages::DeviceMessageView;
+
+  for (auto &handoff : handoffs_)
+  {
+    {
+      std::lock_guard<std::mutex> lock{handoff->mutex};
+      dispatched_.swap(handoff->queue);
+    }
+
+    if (dispatched_.empty())
+    {
+      continue;
+    }
+
+    for (auto &[source, buf] : dispatched_)
+    {
+      /* Already validated by the shard, so parsing cannot fail. */
+      subscriber_(source, *DeviceMessageView::parse(buf.data(), buf.size()));
+    }
+
+    /* The buffers were acquired from the pool of the shard thread, so they are given back to it. */
+    {
+      std::lock_guard<std::mutex> lock{handoff->mutex};
+      for (auto &msg : dispatched_)
+      {
+        handoff->recycled.push_back(std::move(msg.second));
+      }
+    }
 
-  subscriber_(source, msg);
+    dispatched_.clear();
+  }
 }
 
 }  // namespace gateway::endpoint
@@ -0,0 +1,81 @@
+#include "gateway/last_value_cache.h"
+
+#include "commons/subscriber_messages.h"
+
+#include <cstring>
+
+namespace gateway
+{
+
+void LastValueCache::update(const DeviceSources::Source &source,
+    const commons::device_messages::DeviceMessageView &msg)
+{
+  if (capacity_ == 0)
+  {
+    return;
+  }
+
+  auto it = index_.find(msg.topic());
+  if (it == index_.end())
+  {
+    entries_.emplace_front();
+    entries_.front().topic = msg.topic();
+    it = index_.emplace(entries_.front().topic, entries_.begin()).first;
+  }
+  else
+  {
+    bytes_ -= footprint(*it->second);
+    entries_.splice(entries_.begin(), entries_, it->second);
+  }
+
+  /* The payload of a topic is overwritten in place, usually without allocating. */
+  auto &entry = entries_.front();
+  std::memcpy(entry.address, source.address, source.address_len);
+  entry.address_len = source.address_len;
+  std::memcpy(entry.address_bin, source.address_bin, sizeof(entry.address_bin));
+  entry.type = msg.type();
+  entry.payload.assign(msg.payload());
+
+  bytes_ += footprint(entry);
+
+  /* The latest message is always kept, even if it does not fit on its own. */
+  while (bytes_ > capacity_ && entries_.size() > 1)
+  {
+    auto &oldest = entries_.back();
+
+    bytes_ -= footprint(oldest);
+    index_.erase(oldest.topic);
+    entries_.pop_back();
+    evictions_++;
+  }
+}
+
+std::optional<microloop::Buffer> LastValueCache::notification(std::string_view topic,
+    std::uint8_t version) const
+{
+  using commons::device_messages::DeviceMessageView;
+  using commons::subscriber_messages::DeviceNotification;
+  using commons::subscriber_messages::PROTOCOL_V1;
+
+  auto it = index_.find(topic);
+  if (it == index_.end())
+  {
+    return std::nullopt;
+  }
+
+  auto &entry = *it->second;
+  auto msg = DeviceMessageView::from_parts(entry.topic, entry.type, entry.payload);
+  if (!msg)
+  {
+    return std::nullopt;
+  }
+
+  if (version == PROTOCOL_V1)
+  {
+    return DeviceNotification::serialize(std::string_view{entry.address, entry.address_len}, *msg);
+  }
+
+  return DeviceNotification::serialize_v2(entry.address_bin, *msg);
+}
+
+}  // namespace gateway
@@ -0,0 +1,139 @@
+#include "gateway/store_forward.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace gateway
+{
+
+void MemoryStoreForward::append(SubscriberConnection &client,
+    std::string_view topic,
+    const SharedFrame &frame)
+{
+  auto it = logs_.find(topic);
+  if (it == logs_.end())
+  {
+    auto log = std::make_unique<TopicLog>();
+    log->topic = topic;
+
+    std::string_view key = log->topic;
+    it = logs_.emplace(key, std::move(log)).first;
+  }
+
+  auto &log = *it->second;
+
+  /* The frame is appended once for every offline subscriber, but only stored once. */
+  if (log.entries.empty() || log.entries.back().frame != frame)
+  {
+    log.entries.push_back(Entry{next_seq_++, frame});
+  }
+
+  auto seq = log.entries.back().seq;
+  if (client.sf_cursors.try_emplace(log.topic, seq).second)
+  {
+    log.cursors[seq]++;
+  }
+}
+
+void MemoryStoreForward::replay(SubscriberConnection &client, Egress &egress)
+{
+  struct Reader
+  {
+    TopicLog *log;
+    std::uint64_t from;
+    std::deque<Entry>::const_iterator next;
+  };
+
+  std::vector<Reader> readers;
+  readers.reserve(client.sf_cursors.size());
+
+  for (auto &[topic, seq] : client.sf_cursors)
+  {
+    auto &log = *logs_.at(topic);
+    auto next = std::lower_bound(log.entries.begin(), log.entries.end(), seq,
+        [](auto &&entry, auto seq) { return entry.seq < seq; });
+
+    readers.push_back(Reader{&log, seq, next});
+  }
+
+  /* Merge the logs of all the topics, so the frames are delivered in their publishing order. */
+  while (true)
+  {
+    Reader *oldest = nullptr;
+    for (auto &r : readers)
+    {
+      if (r.next != r.log->entries.end() && (!oldest || r.next->seq < oldest->next->seq))
+      {
+        oldest = &r;
+      }
+    }
+
+    /* Frames left over by a congested connection are sent once it drains. */
+    if (!oldest || egress.congested(*client.raw_conn) ||
+        !egress.send(*client.raw_conn, encode_for(client, oldest->next->frame), true))
+    {
+      break;
+    }
+
+    ++oldest->next;
+  }
+
+  client.sf_cursors.clear();
+
+  for (auto &r : readers)
+  {
+    if (r.next == r.log->entries.end())
+    {
+      move_cursor(*r.log, r.from, std::nullopt);
+      continue;
+    }
+
+    /* Frames that could not be delivered are kept for the next re-connection. */
+    auto seq = r.next->seq;
+    client.sf_cursors.emplace(r.log->topic, seq);
+    move_cursor(*r.log, r.from, seq);
+  }
+}
+
+SharedFrame MemoryStoreForward::encode_for(const SubscriberConnection &client,
+    const SharedFrame &frame)
+{
+  using commons::subscriber_messages::DeviceNotification;
+  using commons::subscriber_messages::PROTOCOL_V1;
+
+  if (client.protocol == PROTOCOL_V1)
+  {
+    return frame;
+  }
+
+  return make_shared_frame(DeviceNotification::transcode(frame->data(), frame->size(),
+      client.protocol));
+}
+
+void MemoryStoreForward::move_cursor(TopicLog &log,
+    std::uint64_t from,
+    std::optional<std::uint64_t> to)
+{
+  if (auto it = log.cursors.find(from); --it->second == 0)
+  {
+    log.cursors.erase(it);
+  }
+
+  if (to)
+  {
+    log.cursors[*to]++;
+  }
+
+  auto slowest = log.cursors.empty() ? next_seq_ : log.cursors.begin()->first;
+  while (!log.entries.empty() && log.entries.front().seq < slowest)
+  {
+    log.entries.pop_front();
+  }
+
+  if (log.cursors.empty())
+  {
+    logs_.erase(logs_.find(log.topic));
+  }
+}
+
+}  // namespace gateway
@@ -0,0 +1,590 @@
+#include "gateway/store_forward_log.h"
+
+#include "commons/subscriber_messages.h"
+#include "microloop/kernel_exception.h"
+#include "net_utils/buffer_pool.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <optional>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace gateway
+{
+
+namespace
+{
+
+constexpr std::uint64_t SEGMENT_MAGIC = 0x31474f4c46535747;  // "GWSFLOG1"
+
+/* Segments start with a header, padded so frames start at a fixed offset. */
+constexpr std::uint64_t HEADER_SIZE = 64;
+
+/* Segment files are named after their sequence number, as 16 hex digits followed by ".seg". */
+constexpr int SEGMENT_NAME_LENGTH = 20;
+
+struct SegmentHeader
+{
+  std::uint64_t magic;
+
+  /* File offset right past the last appended frame. */
+  std::uint64_t end;
+};
+
+/* Header of the frames of the subscriber protocol, see commons/src/messages_internal.h. */
+struct FrameHdr
+{
+  std::uint8_t type;
+  std::uint16_t msg_size;
+} __attribute__((packed));
+
+SegmentHeader *header_of(std::uint8_t *base)
+{
+  return reinterpret_cast<SegmentHeader *>(base);
+}
+
+std::string hex_encode(const std::string &s)
+{
+  static constexpr char digits[] = "0123456789abcdef";
+
+  std::string hex;
+  for (unsigned char c : s)
+  {
+    hex.push_back(digits[c >> 4]);
+    hex.push_back(digits[c & 0xf]);
+  }
+
+  return hex;
+}
+
+/* Decode a name made by `hex_encode`, or nothing if \p hex is not such a name. */
+std::optional<std::string> hex_decode(const std::string &hex)
+{
+  auto digit = [](char c) {
+    if (c >= '0' && c <= '9')
+    {
+      return c - '0';
+    }
+
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+  };
+
+  if (hex.empty() || hex.size() % 2 != 0)
+  {
+    return std::nullopt;
+  }
+
+  std::string s;
+  for (std::size_t i = 0; i < hex.size(); i += 2)
+  {
+    auto high = digit(hex[i]);
+    auto low = digit(hex[i + 1]);
+    if (high == -1 || low == -1)
+    {
+      return std::nullopt;
+    }
+
+    s.push_back(static_cast<char>(high << 4 | low));
+  }
+
+  return s;
+}
+
+std::string segment_path(const std::string &dir, std::uint64_t seq)
+{
+  char name[32];
+  std::snprintf(name, sizeof(name), "/%016llx.seg", static_cast<unsigned long long>(seq));
+
+  return dir + name;
+}
+
+void make_dir(const std::string &path)
+{
+  if (mkdir(path.c_str(), 0755) == -1 && errno != EEXIST)
+  {
+    throw microloop::KernelException{errno};
+  }
+}
+
+/**
+ * \brief Find the end of the last whole frame in [begin, reached), so a partially sent frame is
+ * sent again from its start.
+ */
+std::uint64_t last_frame_boundary(const std::uint8_t *base,
+    std::uint64_t begin,
+    std::uint64_t reached)
+{
+  using commons::subscriber_messages::MessageType;
+
+  auto offset = begin;
+  while (offset + sizeof(FrameHdr) <= reached)
+  {
+    auto hdr = reinterpret_cast<const FrameHdr *>(base + offset);
+    auto frame_end = offset + sizeof(FrameHdr) + ntohs(hdr->msg_size);
+    if (hdr->type != MessageType::DEVICE_MSG || frame_end > reached)
+    {
+      break;
+    }
+
+    offset = frame_end;
+  }
+
+  return offset;
+}
+
+/**
+ * \brief Send the file range [offset, end) to a socket, as far as it accepts bytes without
+ * blocking.
+ * \returns Whether the whole range was sent. \p offset is advanced past the bytes sent.
+ */
+bool send_range(int sock, int fd, std::uint64_t &offset, std::uint64_t end)
+{
+  while (offset != end)
+  {
+    off_t off = offset;
+    ssize_t nsent = sendfile(sock, fd, &off, end - offset);
+    if (nsent == -1)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      return false;
+    }
+
+    offset = off;
+  }
+
+  return true;
+}
+
+/**
+ * \brief Send the frames in [offset, end) of a segment through the egress, encoded for the protocol
+ * version of \p client.
+ * \returns Whether all the frames were sent. \p offset is advanced past the frames sent.
+ */
+bool send_frames(SubscriberConnection &client,
+    Egress &egress,
+    const std::uint8_t *base,
+    std::uint64_t &offset,
+    std::uint64_t end)
+{
+  using commons::subscriber_messages::DeviceNotification;
+
+  while (offset != end)
+  {
+    auto hdr = reinterpret_cast<const FrameHdr *>(base + offset);
+    auto size = sizeof(FrameHdr) + ntohs(hdr->msg_size);
+
+    try
+    {
+      if (egress.congested(*client.raw_conn))
+      {
+        return false;
+      }
+
+      auto frame = DeviceNotification::transcode(base + offset, size, client.protocol);
+      if (!egress.send(*client.raw_conn, make_shared_frame(std::move(frame)), true))
+      {
+        return false;
+      }
+    }
+    catch (const std::runtime_error &)
+    {
+      /* A frame corrupted on disk is skipped. */
+    }
+
+    offset += size;
+  }
+
+  return true;
+}
+
+/**
+ * \brief Hand the rest of the frame of a segment that a socket stopped accepting at \p offset over
+ * to the egress, which writes it before anything else sent to the connection.
+ * \param begin A frame boundary not after \p offset.
+ * \returns Whether the connection is not broken. \p offset is advanced past the frame.
+ */
+bool send_rest(SubscriberConnection &client,
+    Egress &egress,
+    const std::uint8_t *base,
+    std::uint64_t begin,
+    std::uint64_t &offset,
+    std::uint64_t end)
+{
+  auto frame_begin = last_frame_boundary(base, begin, offset);
+  auto hdr = reinterpret_cast<const FrameHdr *>(base + frame_begin);
+  auto frame_end = std::min<std::uint64_t>(frame_begin + sizeof(FrameHdr) + ntohs(hdr->msg_size),
+      end);
+
+  auto rest = net_utils::BufferPool::local().acquire(frame_end - offset);
+  std::memcpy(rest.data(), base + offset, rest.size());
+
+  if (!egress.send(*client.raw_conn, make_shared_frame(std::move(rest))))
+  {
+    offset = frame_begin;
+    return false;
+  }
+
+  offset = frame_end;
+  return true;
+}
+
+}  // namespace
+
+StoreForwardLog::StoreForwardLog(std::string root) : root_{std::move(root)}
+{
+  make_dir(root_);
+  recover();
+}
+
+StoreForwardLog::~StoreForwardLog()
+{
+  /* Errors cannot be thrown out of here, so they are only reported, and the other logs synced. */
+  for (auto log : dirty_)
+  {
+    try
+    {
+      sync_tail(*log);
+    }
+    catch (const std::runtime_error &e)
+    {
+      std::fprintf(stderr, "error: cannot sync the log in %s: %s\n", log->dir.c_str(), e.what());
+    }
+  }
+
+  for (auto &[_, log] : logs_)
+  {
+    for (auto &segment : log.segments)
+    {
+      close_segment(log.dir, segment, false);
+    }
+
+    if (log.cursor_fd != -1)
+    {
+      close(log.cursor_fd);
+    }
+  }
+}
+
+void StoreForwardLog::append(SubscriberConnection &client,
+    std::string_view,
+    const SharedFrame &frame)
+{
+  auto &log = log_of(client.client_id);
+
+  if (log.segments.empty() ||
+      header_of(log.segments.back().base)->end + frame->size() > SEGMENT_SIZE)
+  {
+    if (!log.segments.empty())
+    {
+      /* Seal the full segment before moving on to a new one. */
+      sync_tail(log);
+    }
+    else
+    {
+      make_dir(log.dir);
+    }
+
+    log.segments.push_back(open_segment(log.dir, log.next_seq++, true));
+    log.synced = HEADER_SIZE;
+  }
+
+  auto &tail = log.segments.back();
+  auto hdr = header_of(tail.base);
+
+  std::memcpy(tail.base + hdr->end, frame->data(), frame->size());
+  hdr->end += frame->size();
+
+  if (!log.dirty)
+  {
+    log.dirty = true;
+    dirty_.push_back(&log);
+  }
+}
+
+void StoreForwardLog::replay(SubscriberConnection &client, Egress &egress)
+{
+  using commons::subscriber_messages::PROTOCOL_V1;
+
+  auto it = logs_.find(client.client_id);
+  if (it == logs_.end())
+  {
+    return;
+  }
+
+  auto &log = it->second;
+  if (log.segments.empty())
+  {
+    return;
+  }
+
+  auto &conn = *client.raw_conn;
+
+  /* Frames are sent bypassing the egress, so nothing may still be queued for this connection. */
+  egress.quiesce(conn);
+
+  client.replaying = false;
+
+  while (!log.segments.empty())
+  {
+    auto &segment = log.segments.front();
+    auto end = header_of(segment.base)->end;
+
+    auto begin = segment.seq == log.cursor_seq ? log.cursor_offset : HEADER_SIZE;
+    auto offset = begin;
+
+    /*
+     * Frames are stored using the version 1 encoding, so only those clients get them verbatim.
+     * Frames spilled by a congested subscriber go through the egress.
+     */
+    auto verbatim = client.protocol == PROTOCOL_V1 && !client.spilled && egress.idle(conn);
+    auto sent = verbatim ? send_range(conn.fd(), segment.fd, offset, end) :
+                           send_frames(client, egress, segment.base, offset, end);
+
+    /*
+     * Once the socket is full, the replay goes on after the egress drained it, and notifications
+     * are stored behind the frames left meanwhile, so they keep their order.
+     */
+    if (!sent && verbatim && send_rest(client, egress, segment.base, begin, offset, end))
+    {
+      client.replaying = egress.blocked(conn);
+      sent = offset == end;
+
+      if (!sent && !client.replaying)
+      {
+        log.cursor_seq = segment.seq;
+        log.cursor_offset = offset;
+        continue;
+      }
+    }
+
+    if (!sent)
+    {
+      log.cursor_seq = segment.seq;
+      log.cursor_offset = last_frame_boundary(segment.base, begin, offset);
+      save_cursor(log);
+
+      return;
+    }
+
+    close_segment(log.dir, segment, true);
+    log.segments.pop_front();
+  }
+
+  /* Everything was delivered. New frames go to a fresh segment. */
+  client.replaying = false;
+  log.cursor_seq = log.next_seq;
+  log.cursor_offset = HEADER_SIZE;
+  save_cursor(log);
+}
+
+void StoreForwardLog::commit()
+{
+  for (auto log : dirty_)
+  {
+    sync_tail(*log);
+    log->dirty = false;
+  }
+
+  dirty_.clear();
+}
+
+StoreForwardLog::ClientLog &StoreForwardLog::log_of(const std::string &client_id)
+{
+  auto [it, inserted] = logs_.try_emplace(client_id);
+  if (inserted)
+  {
+    it->second.dir = root_ + "/" + hex_encode(client_id);
+    it->second.cursor_offset = HEADER_SIZE;
+  }
+
+  return it->second;
+}
+
+void StoreForwardLog::recover()
+{
+  DIR *root = opendir(root_.c_str());
+  if (!root)
+  {
+    throw microloop::KernelException{errno};
+  }
+
+  while (auto entry = readdir(root))
+  {
+    /* Entries not made by the log, such as ".", "..", or files left there by hand, are skipped. */
+    auto client_id = hex_decode(entry->d_name);
+    if (!client_id)
+    {
+      continue;
+    }
+
+    DIR *dir = opendir((root_ + "/" + entry->d_name).c_str());
+    if (!dir)
+    {
+      continue;
+    }
+
+    auto &log = log_of(*client_id);
+
+    std::vector<std::uint64_t> seqs;
+    while (auto file = readdir(dir))
+    {
+      unsigned long long seq;
+      int length = 0;
+      if (std::sscanf(file->d_name, "%16llx.seg%n", &seq, &length) == 1 &&
+          length == SEGMENT_NAME_LENGTH && file->d_name[length] == '\0')
+      {
+        seqs.push_back(seq);
+      }
+    }
+
+    closedir(dir);
+
+    std::sort(seqs.begin(), seqs.end());
+
+    log.cursor_fd = open((log.dir + "/cursor").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (log.cursor_fd == -1)
+    {
+      throw microloop::KernelException{errno};
+    }
+
+    std::uint64_t cursor[2];
+    if (pread(log.cursor_fd, cursor, sizeof(cursor), 0) == sizeof(cursor))
+    {
+      log.cursor_seq = cursor[0];
+      log.cursor_offset = cursor[1];
+    }
+
+    for (auto seq : seqs)
+    {
+      auto segment = open_segment(log.dir, seq, false);
+      if (seq < log.cursor_seq || header_of(segment.base)->magic != SEGMENT_MAGIC)
+      {
+        /* Already delivered, or never completely created. */
+        close_segment(log.dir, segment, true);
+        continue;
+      }
+
+      /*
+       * The header may have reached the disk before the frames it covers, so only keep the frames
+       * that are whole.
+       */
+      auto hdr = header_of(segment.base);
+      hdr->end = last_frame_boundary(segment.base, HEADER_SIZE, hdr->end);
+
+      log.segments.push_back(segment);
+    }
+
+    log.next_seq = std::max(log.cursor_seq, seqs.empty() ? 0 : seqs.back() + 1);
+    if (!log.segments.empty())
+    {
+      log.synced = header_of(log.segments.back().base)->end;
+    }
+  }
+
+  closedir(root);
+}
+
+StoreForwardLog::Segment StoreForwardLog::open_segment(const std::string &dir,
+    std::uint64_t seq,
+    bool create)
+{
+  auto path = segment_path(dir, seq);
+
+  int flags = O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0);
+  int fd = open(path.c_str(), flags, 0644);
+  if (fd == -1)
+  {
+    throw microloop::KernelException{errno};
+  }
+
+  if (create && ftruncate(fd, SEGMENT_SIZE) == -1)
+  {
+    throw microloop::KernelException{errno};
+  }
+
+  void *base = mmap(nullptr, SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED)
+  {
+    throw microloop::KernelException{errno};
+  }
+
+  Segment segment{seq, fd, static_cast<std::uint8_t *>(base)};
+  if (create)
+  {
+    *header_of(segment.base) = SegmentHeader{SEGMENT_MAGIC, HEADER_SIZE};
+  }
+
+  return segment;
+}
+
+void StoreForwardLog::close_segment(const std::string &dir, Segment &segment, bool remove)
+{
+  munmap(segment.base, SEGMENT_SIZE);
+  close(segment.fd);
+
+  if (remove)
+  {
+    unlink(segment_path(dir, segment.seq).c_str());
+  }
+}
+
+void StoreForwardLog::sync_tail(ClientLog &log)
+{
+  if (log.segments.empty())
+  {
+    return;
+  }
+
+  auto &tail = log.segments.back();
+  auto end = header_of(tail.base)->end;
+
+  static const std::uint64_t page_size = sysconf(_SC_PAGESIZE);
+  auto from = log.synced / page_size * page_size;
+
+  /* The frames first, then the header pointing past them. */
+  if (end > from && msync(tail.base + from, end - from, MS_SYNC) == -1)
+  {
+    throw microloop::KernelException{errno};
+  }
+
+  if (msync(tail.base, page_size, MS_SYNC) == -1)
+  {
+    throw microloop::KernelException{errno};
+  }
+
+  log.synced = end;
+}
+
+void StoreForwardLog::save_cursor(ClientLog &log)
+{
+  if (log.cursor_fd == -1)
+  {
+    log.cursor_fd = open((log.dir + "/cursor").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (log.cursor_fd == -1)
+    {
+      throw microloop::KernelException{errno};
+    }
+  }
+
+  std::uint64_t cursor[2]{log.cursor_seq, log.cursor_offset};
+  if (pwrite(log.cursor_fd, cursor, sizeof(cursor), 0) == -1 || fdatasync(log.cursor_fd) == -1)
+  {
+    throw microloop::KernelException{errno};
+  }
+}
+
+}  // namespace gateway
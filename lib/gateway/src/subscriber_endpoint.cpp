@@ -2,7 +2,10 @@
 
 #include "commons/subscriber_messages.h"
 
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
+#include <string>
 #include <utility>
 
 namespace gateway::endpoint
@@ -19,70 +22,118 @@ void SubscriberEndpoint::on_tcp_data(microloop::net::TcpServer::PeerConnection &
   using namespace commons::subscriber_messages;
   using namespace commons::server_response;
 
-  auto is_pending_conn = subscribers_.is_pending(conn.fd());
-
   if (buf.empty())
   {
-    if (!is_pending_conn)
+    if (!subscribers_.is_pending(conn.fd()))
     {
       on_disconnect(*subscribers_.with_fd(conn.fd()));
     }
 
+    decoders_.erase(conn.fd());
     subscribers_.disconnect(conn);
+    egress_.quiesce(conn);
+    egress_.detach(conn);
     server_.close_conn(conn);
 
     return;
   }
 
-  std::uint8_t msg_type = static_cast<const std::uint8_t *>(buf.data())[0];
+  auto &decoder = decoders_[conn.fd()];
+
+  auto on_frame = [&](const std::uint8_t *frame, std::size_t size) {
+    return on_message(conn, frame, size);
+  };
 
-  if (!is_valid_message_type(msg_type))
+  if (decoder.feed(buf.data(), buf.size(), on_frame))
   {
-    ServerResponse error_response{StatusCode::INVALID_MSG_TYPE};
-    conn.send(error_response.serialize());
     return;
   }
 
-  auto [message, consumed] = from_buffer(buf);
+  /* The stream cannot be decoded any further, so the connection is dropped. */
+  if (decoder.malformed())
+  {
+    ServerResponse error_response{StatusCode::MALFORMED_MSG};
+    send(conn, error_response.serialize(protocol_of(conn)));
+
+    close(conn);
+  }
+
+  decoders_.erase(conn.fd());
+}
 
-  if (is_pending_conn)
+bool SubscriberEndpoint::on_message(microloop::net::TcpServer::PeerConnection &conn,
+    const std::uint8_t *frame,
+    std::size_t size)
+{
+  using namespace commons::subscriber_messages;
+  using namespace commons::server_response;
+
+  std::uint8_t msg_type = frame[0];
+
+  if (subscribers_.is_pending(conn.fd()))
   {
     if (msg_type != MessageType::GREETING)
     {
       ServerResponse error_response{StatusCode::EXPECTED_GREETING};
-      conn.send(error_response.serialize());
+      send(conn, error_response.serialize());
 
-      server_.close_conn(conn);
-      subscribers_.disconnect(conn);
+      close(conn);
 
-      return;
+      return false;
     }
 
-    auto greeting = std::get<GreetingMessage>(message);
+    auto greeting = std::get<GreetingMessage>(from_buffer(frame, size).first);
 
     auto subscriber_conn = subscribers_.attach_client_id(conn, greeting.client_id);
     if (!subscriber_conn)
     {
       ServerResponse error_response{StatusCode::DUPLICATE_CLIENT_ID};
-      conn.send(error_response.serialize());
+      send(conn, error_response.serialize());
 
-      server_.close_conn(conn);
-      subscribers_.disconnect(conn);
+      close(conn);
 
-      return;
+      return false;
+    }
+
+    subscriber_conn->protocol = std::clamp(greeting.version, PROTOCOL_V1, PROTOCOL_LATEST);
+    subscriber_conn->defined_topics.clear();
+    subscribers_.clear_conflated(*subscriber_conn);
+    subscriber_conn->spilled = false;
+    subscriber_conn->replaying = false;
+    if (subscriber_conn->protocol != PROTOCOL_V1)
+    {
+      /* The acknowledgement is the last message using the version 1 encoding. */
+      auto notes = "protocol=" + std::to_string(subscriber_conn->protocol);
+      ServerResponse ack{StatusCode::OK, std::move(notes)};
+      send(conn, ack.serialize());
     }
 
     on_client_greeting(*subscriber_conn);
 
-    return;
+    return true;
   }
 
   if (msg_type == MessageType::GREETING)
   {
     ServerResponse error_response{StatusCode::EXPECTED_GREETING};
-    conn.send(error_response.serialize());
+    send(conn, error_response.serialize(protocol_of(conn)));
 
-    return;
+    return true;
+  }
+
+  SubscriberMessage message;
+  try
+  {
+    message = from_buffer(frame, size).first;
+  }
+  catch (const std::runtime_error &)
+  {
+    ServerResponse error_response{StatusCode::MALFORMED_MSG};
+    send(conn, error_response.serialize(protocol_of(conn)));
+
+    close(conn);
+
+    return false;
   }
 
   std::visit(
@@ -99,8 +150,54 @@ void SubscriberEndpoint::on_tcp_data(microloop::net::TcpServer::PeerConnection &
         {
           on_unsubscribe(subscriber, arg);
         }
+        else if constexpr (std::is_same_v<T, BulkSubscribeRequest>)
+        {
+          on_bulk_subscribe(subscriber, arg);
+        }
+        else if constexpr (std::is_same_v<T, BulkUnsubscribeRequest>)
+        {
+          on_bulk_unsubscribe(subscriber, arg);
+        }
+        else if constexpr (std::is_same_v<T, SnapshotRequest>)
+        {
+          on_snapshot(subscriber);
+        }
       },
       message);
+
+  return true;
+}
+
+std::uint8_t SubscriberEndpoint::protocol_of(microloop::net::TcpServer::PeerConnection &conn)
+{
+  using commons::subscriber_messages::PROTOCOL_V1;
+
+  auto subscriber = subscribers_.with_fd(conn.fd());
+  return subscriber ? subscriber->protocol : PROTOCOL_V1;
+}
+
+void SubscriberEndpoint::drop(SubscriberConnection &subscriber)
+{
+  auto &conn = *subscriber.raw_conn;
+
+  on_disconnect(subscriber);
+
+  decoders_.erase(conn.fd());
+  close(conn);
+}
+
+void SubscriberEndpoint::close(microloop::net::TcpServer::PeerConnection &conn)
+{
+  egress_.quiesce(conn);
+  egress_.detach(conn);
+  server_.close_conn(conn);
+  subscribers_.disconnect(conn);
+}
+
+bool SubscriberEndpoint::send(microloop::net::TcpServer::PeerConnection &conn,
+    microloop::Buffer &&frame)
+{
+  return egress_.send(conn, make_shared_frame(std::move(frame)));
 }
 
 void SubscriberEndpoint::on_disconnect(SubscriberConnection &subscriber)
@@ -113,16 +210,7 @@ void SubscriberEndpoint::on_client_greeting(SubscriberConnection &subscriber)
   std::cout << "New client \"" << subscriber.client_id << "\" connected from "
             << subscriber.raw_conn->str(false) << ".\n";
 
-  while (!subscriber.pending_messages.empty())
-  {
-    auto &msg = subscriber.pending_messages.front();
-    if (!subscriber.raw_conn->send(msg.serialize()))
-    {
-      break;
-    }
-
-    subscriber.pending_messages.pop();
-  }
+  store_forward_.replay(subscriber, egress_);
 }
 
 void SubscriberEndpoint::on_subscribe(SubscriberConnection &subscriber,
@@ -131,16 +219,26 @@ void SubscriberEndpoint::on_subscribe(SubscriberConnection &subscriber,
   using namespace commons::subscriber_messages;
   using namespace commons::server_response;
 
+  if (!TopicTrie::valid(msg.topic))
+  {
+    ServerResponse error_response{StatusCode::INVALID_TOPIC, msg.topic};
+    send(*subscriber.raw_conn, error_response.serialize(subscriber.protocol));
+
+    return;
+  }
+
   if (!subscribers_.add_subscription(subscriber.client_id, msg))
   {
     ServerResponse error_response{StatusCode::DUPLICATE_SUBSCRIPTION, msg.topic};
-    subscriber.raw_conn->send(error_response.serialize());
+    send(*subscriber.raw_conn, error_response.serialize(subscriber.protocol));
 
     return;
   }
 
   ServerResponse confirmation{StatusCode::SUBSCRIBE_SUCCESSFUL, msg.topic};
-  subscriber.raw_conn->send(confirmation.serialize());
+  send(*subscriber.raw_conn, confirmation.serialize(subscriber.protocol));
+
+  send_last_values(subscriber, msg.topic);
 }
 
 /* Callback to be invoked when a client sends an unsubscribe request. */
@@ -153,13 +251,89 @@ void SubscriberEndpoint::on_unsubscribe(SubscriberConnection &subscriber,
   if (!subscribers_.remove_subscription(subscriber.client_id, msg.topic))
   {
     ServerResponse error_response{StatusCode::SUBSCRIPTION_NOT_FOUND};
-    subscriber.raw_conn->send(error_response.serialize());
+    send(*subscriber.raw_conn, error_response.serialize(subscriber.protocol));
 
     return;
   }
 
   ServerResponse confirmation{StatusCode::UNSUBSCRIBE_SUCCESSFUL, msg.topic};
-  subscriber.raw_conn->send(confirmation.serialize());
+  send(*subscriber.raw_conn, confirmation.serialize(subscriber.protocol));
+}
+
+void SubscriberEndpoint::on_bulk_subscribe(SubscriberConnection &subscriber,
+    const commons::subscriber_messages::BulkSubscribeRequest &msg)
+{
+  using namespace commons::subscriber_messages;
+
+  auto added = subscribers_.add_subscriptions(subscriber.client_id, msg.subscriptions);
+
+  BulkResponse response{MessageType::BULK_SUBSCRIBE, added};
+  send(*subscriber.raw_conn, response.serialize(subscriber.protocol));
+
+  for (std::size_t i = 0; i < added.size(); i++)
+  {
+    if (added[i])
+    {
+      send_last_values(subscriber, msg.subscriptions[i].topic);
+    }
+  }
+}
+
+void SubscriberEndpoint::on_bulk_unsubscribe(SubscriberConnection &subscriber,
+    const commons::subscriber_messages::BulkUnsubscribeRequest &msg)
+{
+  using namespace commons::subscriber_messages;
+
+  auto removed = subscribers_.remove_subscriptions(subscriber.client_id, msg.topics);
+
+  BulkResponse response{MessageType::BULK_UNSUBSCRIBE, std::move(removed)};
+  send(*subscriber.raw_conn, response.serialize(subscriber.protocol));
+}
+
+void SubscriberEndpoint::on_snapshot(SubscriberConnection &subscriber)
+{
+  using namespace commons::subscriber_messages;
+  using namespace commons::server_response;
+
+  std::size_t sent = 0;
+
+  for (auto &[_, s] : subscriber.subscriptions)
+  {
+    sent += send_last_values(subscriber, subscribers_.topic_of(s));
+  }
+
+  /* Tells the subscriber the snapshot is complete. */
+  ServerResponse done{StatusCode::OK, "snapshot=" + std::to_string(sent)};
+  send(*subscriber.raw_conn, done.serialize(subscriber.protocol));
+}
+
+std::size_t SubscriberEndpoint::send_last_values(SubscriberConnection &subscriber,
+    std::string_view topic)
+{
+  std::size_t sent = 0;
+
+  auto send_value = [&](std::string_view topic) {
+    if (auto notification = last_values_.notification(topic, subscriber.protocol))
+    {
+      auto frame = make_shared_frame(std::move(*notification));
+      sent += egress_.send(*subscriber.raw_conn, std::move(frame), true);
+    }
+  };
+
+  if (!TopicTrie::is_pattern(topic))
+  {
+    send_value(topic);
+    return sent;
+  }
+
+  last_values_.for_each_topic([&](std::string_view cached) {
+    if (TopicTrie::matches(topic, cached))
+    {
+      send_value(cached);
+    }
+  });
+
+  return sent;
 }
 
 }  // namespace gateway::endpoint
@@ -0,0 +1,246 @@
+#include "gateway/topic_trie.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace gateway
+{
+
+namespace
+{
+
+/**
+ * \brief Split the first level off \p rest, which is left with the following levels.
+ * \param done Set to whether the returned level is the last one.
+ */
+std::string_view next_level(std::string_view &rest, bool &done)
+{
+  auto sep = rest.find(TopicTrie::SEPARATOR);
+  auto level = rest.substr(0, sep);
+
+  done = sep == std::string_view::npos;
+  rest = done ? std::string_view{} : rest.substr(sep + 1);
+
+  return level;
+}
+
+/* Remove the subscriber \p client from an unordered list of subscribers. */
+bool remove_subscriber(std::vector<TopicSubscriber> &subscribers,
+    const SubscriberConnection *client)
+{
+  auto it = std::find_if(subscribers.begin(), subscribers.end(),
+      [client](auto &&subscriber) { return subscriber.client == client; });
+
+  if (it == subscribers.end())
+  {
+    return false;
+  }
+
+  *it = std::move(subscribers.back());
+  subscribers.pop_back();
+
+  return true;
+}
+
+}  // namespace
+
+bool TopicTrie::is_pattern(std::string_view topic)
+{
+  for (bool done = false; !done;)
+  {
+    auto level = next_level(topic, done);
+    if (level == SINGLE_LEVEL || level == MULTI_LEVEL)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool TopicTrie::valid(std::string_view topic)
+{
+  for (bool done = false; !done;)
+  {
+    auto level = next_level(topic, done);
+    if (level == SINGLE_LEVEL || (level == MULTI_LEVEL && done))
+    {
+      continue;
+    }
+
+    if (level.find_first_of("+#") != std::string_view::npos)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool TopicTrie::matches(std::string_view pattern, std::string_view topic)
+{
+  bool pattern_done = false;
+  bool topic_done = false;
+
+  while (!pattern_done)
+  {
+    auto level = next_level(pattern, pattern_done);
+    if (level == MULTI_LEVEL)
+    {
+      return true;
+    }
+
+    if (topic_done)
+    {
+      return false;
+    }
+
+    auto topic_level = next_level(topic, topic_done);
+    if (level != SINGLE_LEVEL && level != topic_level)
+    {
+      return false;
+    }
+  }
+
+  return topic_done;
+}
+
+void TopicTrie::insert(std::string_view pattern, TopicSubscriber subscriber)
+{
+  auto node = &root_;
+  size_++;
+
+  for (bool done = false; !done;)
+  {
+    auto level = next_level(pattern, done);
+
+    if (level == MULTI_LEVEL)
+    {
+      node->descendants.push_back(std::move(subscriber));
+      return;
+    }
+
+    if (level == SINGLE_LEVEL)
+    {
+      if (!node->any)
+      {
+        node->any = std::make_unique<Node>();
+      }
+
+      node = node->any.get();
+      continue;
+    }
+
+    auto it = node->children.find(level);
+    if (it == node->children.end())
+    {
+      /* The key views the level owned by the child, which never moves in memory. */
+      auto child = std::make_unique<Node>();
+      child->level = std::string{level};
+
+      std::string_view key = child->level;
+      it = node->children.emplace(key, std::move(child)).first;
+    }
+
+    node = it->second.get();
+  }
+
+  node->subscribers.push_back(std::move(subscriber));
+}
+
+bool TopicTrie::erase(std::string_view pattern, const SubscriberConnection *client)
+{
+  if (!erase(root_, pattern, client))
+  {
+    return false;
+  }
+
+  size_--;
+  return true;
+}
+
+void TopicTrie::match(std::string_view topic, std::vector<const TopicSubscriber *> &out) const
+{
+  match(root_, topic, false, out);
+}
+
+void TopicTrie::match(const Node &node,
+    std::string_view rest,
+    bool done,
+    std::vector<const TopicSubscriber *> &out) const
+{
+  /* A '#' level matches the levels left, if any. */
+  for (auto &subscriber : node.descendants)
+  {
+    out.push_back(&subscriber);
+  }
+
+  if (done)
+  {
+    for (auto &subscriber : node.subscribers)
+    {
+      out.push_back(&subscriber);
+    }
+
+    return;
+  }
+
+  auto level = next_level(rest, done);
+
+  if (auto it = node.children.find(level); it != node.children.end())
+  {
+    match(*it->second, rest, done, out);
+  }
+
+  if (node.any)
+  {
+    match(*node.any, rest, done, out);
+  }
+}
+
+bool TopicTrie::erase(Node &node, std::string_view rest, const SubscriberConnection *client)
+{
+  bool done;
+  auto level = next_level(rest, done);
+
+  if (level == MULTI_LEVEL)
+  {
+    return remove_subscriber(node.descendants, client);
+  }
+
+  auto erase_below = [&](Node &child) {
+    return done ? remove_subscriber(child.subscribers, client) : erase(child, rest, client);
+  };
+
+  if (level == SINGLE_LEVEL)
+  {
+    if (!node.any)
+    {
+      return false;
+    }
+
+    auto erased = erase_below(*node.any);
+    if (node.any->empty())
+    {
+      node.any.reset();
+    }
+
+    return erased;
+  }
+
+  auto it = node.children.find(level);
+  if (it == node.children.end())
+  {
+    return false;
+  }
+
+  auto erased = erase_below(*it->second);
+  if (it->second->empty())
+  {
+    node.children.erase(it);
+  }
+
+  return erased;
+}
+
+}  // namespace gateway
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "microloop/buffer.h"
+
+#include <cstdint>
+#include <limits>
+#include <netinet/in.h>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <utility>
+
+namespace net_utils
+{
+
+class AddressWrapper
+{
+public:
+  static constexpr std::size_t str_maxlen = INET6_ADDRSTRLEN +  // The maximum length of the IP part
+      1 +  // The colon sign
+      std::numeric_limits<std::uint16_t>::digits10;  // The maximum length of the port part
+
+  /*
+   * Size of the binary form of an address: an IPv6 address (IPv4 addresses are mapped) followed by
+   * the port, in network byte order.
+   */
+  static constexpr std::size_t bin_size = 18;
+
+  AddressWrapper() = default;
+
+  AddressWrapper(std::uint32_t server_sock, sockaddr_storage addr, socklen_t addrlen) :
+      server_sock_{server_sock}, addr_{addr}, addrlen_{addrlen}
+  {}
+
+  /**
+   * Send a buffer to this client from the UDP server.
+   *
+   * This member function is a thin wrapper around the `sendto` syscall.
+   *
+   * \param buf The buffer to be sent to the peer socket.
+   * \return Whether the operation succeeded or not. If only a fraction of the entire buffer is
+   * sent, then the function will report it as a failure.
+   */
+  bool send(const microloop::Buffer &buf) const;
+
+  /**
+   * \brief Get a string representation of this peer connection. The representation will contain
+   * a pretty representation of the socket address.
+   * \return The string representation of an address wrapper with the following format:
+   *     <ip>:<port>
+   */
+  std::string str() const;
+
+  /**
+   * \brief Write the binary form of this address, `bin_size` bytes long, at \p dest.
+   */
+  void to_binary(std::uint8_t *dest) const;
+
+  /**
+   * \brief Build an address from its binary form, as written by `to_binary`.
+   */
+  static AddressWrapper from_binary(const std::uint8_t *bin);
+
+  /**
+   * \brief Convert an address formatted by `str` to its binary form, written at \p dest.
+   * \returns Whether \p str holds a valid address.
+   */
+  static bool str_to_binary(std::string_view str, std::uint8_t *dest);
+
+  auto addr() const
+  {
+    return std::make_pair(addr_, addrlen_);
+  }
+
+private:
+  sockaddr_storage addr_;
+  socklen_t addrlen_;
+  std::uint32_t server_sock_;
+};
+
+}  // namespace net_utils
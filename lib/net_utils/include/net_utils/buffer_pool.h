@@ -0,0 +1,89 @@
+#pragma once
+
+#include "microloop/buffer.h"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace net_utils
+{
+
+/**
+ * \brief Per-thread pool of recycled buffers.
+ *
+ * Buffers are classed by their exact size, so a recycled buffer never has to be resized. Version 1
+ * frames have fixed layouts, so a handful of sizes covers nearly all of their traffic. Version 2
+ * and 3 frames are as long as their topics and values, so a buffer is only reused by a frame of the
+ * same length, such as a later notification of the same topic and payload type, and the hit rate
+ * is lower for those subscribers. Each thread owns its pool, so no locking is involved. Buffers
+ * larger than `MAX_POOLED_SIZE` bypass the pool.
+ */
+class BufferPool
+{
+public:
+  /* The largest buffer size to be recycled. */
+  static constexpr std::size_t MAX_POOLED_SIZE = 2048;
+
+  /* The maximum number of free buffers kept for a single size class. */
+  static constexpr std::size_t MAX_FREE_PER_CLASS = 256;
+
+  struct Stats
+  {
+    /* Buffers acquired from the free lists. */
+    std::uint64_t hits = 0;
+
+    /* Buffers that had to be allocated. */
+    std::uint64_t misses = 0;
+
+    /* Buffers released back but freed because their free list was full. */
+    std::uint64_t overflows = 0;
+
+    /* Buffers currently kept in the free lists. */
+    std::uint64_t cached = 0;
+
+    /* The largest number of buffers ever kept in the free lists at once. */
+    std::uint64_t high_water = 0;
+  };
+
+  /**
+   * \brief Get the pool of the calling thread.
+   */
+  static BufferPool &local();
+
+  /**
+   * \brief Get the statistics summed over the pools of all the threads.
+   */
+  static Stats total_stats();
+
+  BufferPool(const BufferPool &) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+
+  ~BufferPool();
+
+  /**
+   * \brief Get a zero-filled buffer of exactly \p size bytes.
+   */
+  microloop::Buffer acquire(std::size_t size);
+
+  /**
+   * \brief Give a buffer back to the pool, to be handed out by a later `acquire` call.
+   */
+  void release(microloop::Buffer &&buf);
+
+  Stats stats() const;
+
+private:
+  BufferPool();
+
+  std::vector<std::vector<microloop::Buffer>> free_lists_;
+
+  /* Counters are only written by the owning thread, but may be read by any thread. */
+  std::atomic<std::uint64_t> hits_{0};
+  std::atomic<std::uint64_t> misses_{0};
+  std::atomic<std::uint64_t> overflows_{0};
+  std::atomic<std::uint64_t> cached_{0};
+  std::atomic<std::uint64_t> high_water_{0};
+};
+
+}  // namespace net_utils
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "net_utils/address_wrapper.h"
+
+#include <cstdint>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <vector>
+
+namespace net_utils
+{
+
+/**
+ * \brief A datagram received as part of a batch. The payload is owned by the batch and is only
+ * valid until the next receive operation on that batch.
+ */
+struct Datagram
+{
+  AddressWrapper source;
+  const std::uint8_t *data;
+  std::size_t size;
+};
+
+/**
+ * \brief Pre-allocated slab of receive buffers, filled with a single `recvmmsg` call.
+ *
+ * All the buffers, socket addresses and message headers are allocated once, upon construction, so
+ * receiving a batch of datagrams does not allocate any memory.
+ */
+class DatagramBatch
+{
+public:
+  DatagramBatch(std::size_t capacity, std::size_t max_datagram_size);
+
+  DatagramBatch(const DatagramBatch &) = delete;
+  DatagramBatch &operator=(const DatagramBatch &) = delete;
+
+  /**
+   * \brief Receive up to `capacity()` datagrams from the socket \p sock.
+   * \param flags Flags to be passed to `recvmmsg`. Use `MSG_DONTWAIT` for non-blocking reads.
+   * \return The number of datagrams received. Zero is returned if no datagram is available.
+   */
+  std::size_t receive(std::uint32_t sock, int flags);
+
+  Datagram operator[](std::size_t i) const
+  {
+    const auto &hdr = headers_[i].msg_hdr;
+    return Datagram{AddressWrapper{sock_, addrs_[i], hdr.msg_namelen},
+        slab_.data() + i * max_datagram_size_, headers_[i].msg_len};
+  }
+
+  std::size_t size() const
+  {
+    return size_;
+  }
+
+  std::size_t capacity() const
+  {
+    return headers_.size();
+  }
+
+private:
+  std::size_t max_datagram_size_;
+  std::size_t size_ = 0;
+  std::uint32_t sock_ = 0;
+
+  std::vector<std::uint8_t> slab_;
+  std::vector<sockaddr_storage> addrs_;
+  std::vector<iovec> iovecs_;
+  std::vector<mmsghdr> headers_;
+};
+
+}  // namespace net_utils
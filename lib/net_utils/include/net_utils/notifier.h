@@ -0,0 +1,88 @@
+#pragma once
+
+#include "microloop/event_source.h"
+#include "microloop/kernel_exception.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <functional>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <utility>
+
+namespace net_utils
+{
+
+/**
+ * \brief Event source used to wake the event loop up from other threads.
+ *
+ * Any thread may call `notify`. The callback runs on the event loop thread, once for any number of
+ * notifications issued since its previous run.
+ */
+class Notifier : public microloop::EventSource
+{
+public:
+  using Callback = std::function<void()>;
+
+  Notifier(Callback &&callback) : EventSource{create_eventfd()}, on_notify_{std::move(callback)}
+  {}
+
+  /**
+   * \brief Wake the event loop up. Safe to be called from any thread.
+   */
+  void notify()
+  {
+    std::uint64_t one = 1;
+    if (write(get_fd(), &one, sizeof(one)) == -1 && errno != EAGAIN)
+    {
+      throw microloop::KernelException{errno};
+    }
+  }
+
+  std::uint32_t produced_events() const override
+  {
+    return EPOLLIN;
+  }
+
+  bool native_async() const override
+  {
+    /* Run the callback on the main thread, where the consumers of the notifications live. */
+    return true;
+  }
+
+  void start() override
+  {}
+
+  void run_callback() override
+  {
+    std::uint64_t count;
+    if (read(get_fd(), &count, sizeof(count)) == -1)
+    {
+      if (errno == EAGAIN)
+      {
+        return;
+      }
+
+      throw microloop::KernelException{errno};
+    }
+
+    on_notify_();
+  }
+
+private:
+  static std::uint32_t create_eventfd()
+  {
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd == -1)
+    {
+      throw microloop::KernelException{errno};
+    }
+
+    return static_cast<std::uint32_t>(fd);
+  }
+
+private:
+  Callback on_notify_;
+};
+
+}  // namespace net_utils
@@ -3,71 +3,67 @@
 #include "microloop/buffer.h"
 #include "microloop/event_source.h"
 #include "microloop/kernel_exception.h"
+#include "net_utils/address_wrapper.h"
+#include "net_utils/buffer_pool.h"
+#include "net_utils/datagram_batch.h"
 
-#include <limits>
-#include <netinet/in.h>
-#include <string>
+#include <cstring>
+#include <functional>
 #include <sys/socket.h>
-#include <tuple>
+#include <utility>
 
 namespace net_utils
 {
 
-class AddressWrapper
+/**
+ * \brief Event source receiving datagrams from a UDP socket.
+ *
+ * Every time the socket becomes readable, up to `batch_size` datagrams are drained from it using a
+ * single `recvmmsg` call into a pre-allocated slab of buffers. The whole batch is then handed to
+ * the batch callback.
+ */
+class ReceiveFrom : public microloop::EventSource
 {
 public:
-  static constexpr std::size_t str_maxlen = INET6_ADDRSTRLEN +  // The maximum length of the IP part
-      1 +  // The colon sign
-      std::numeric_limits<std::uint16_t>::digits10;  // The maximum length of the port part
+  using Callback = std::function<void(const AddressWrapper &, const microloop::Buffer &)>;
+  using BatchCallback = std::function<void(const DatagramBatch &)>;
 
-  AddressWrapper() = default;
+  static constexpr std::size_t DEFAULT_MAX_READ_SIZE = 2048;
+  static constexpr std::size_t DEFAULT_BATCH_SIZE = 64;
 
-  AddressWrapper(std::uint32_t server_sock, sockaddr_storage addr, socklen_t addrlen) :
-      server_sock_{server_sock}, addr_{addr}, addrlen_{addrlen}
+  ReceiveFrom(std::uint32_t sock,
+      BatchCallback &&callback,
+      std::size_t batch_size = DEFAULT_BATCH_SIZE,
+      std::size_t max_read_size = DEFAULT_MAX_READ_SIZE) :
+      EventSource{sock}, on_recv_{std::move(callback)}, batch_{batch_size, max_read_size}
   {}
 
-  /**
-   * Send a buffer to this client from the UDP server.
-   *
-   * This member function is a thin wrapper around the `sendto` syscall.
-   *
-   * \param buf The buffer to be sent to the peer socket.
-   * \return Whether the operation succeeded or not. If only a fraction of the entire buffer is
-   * sent, then the function will report it as a failure.
-   */
-  bool send(const microloop::Buffer &buf) const;
+  ReceiveFrom(std::uint32_t sock,
+      Callback &&callback,
+      std::size_t max_read_size = DEFAULT_MAX_READ_SIZE) :
+      ReceiveFrom{sock, per_datagram(std::move(callback)), DEFAULT_BATCH_SIZE, max_read_size}
+  {}
 
   /**
-   * \brief Get a string representation of this peer connection. The representation will contain
-   * a pretty representation of the socket address.
-   * \return The string representation of an address wrapper with the following format:
-   *     <ip>:<port>
+   * \brief Adapt a callback that handles a single datagram at a time to a batch callback. Every
+   * datagram is copied into its own pooled buffer before being passed to \p callback.
    */
-  std::string str() const;
-
-  auto addr() const
+  static BatchCallback per_datagram(Callback &&callback)
   {
-    return std::make_pair(addr_, addrlen_);
-  }
+    return [callback = std::move(callback)](const DatagramBatch &batch) {
+      for (std::size_t i = 0; i < batch.size(); i++)
+      {
+        auto datagram = batch[i];
 
-private:
-  sockaddr_storage addr_;
-  socklen_t addrlen_;
-  std::uint32_t server_sock_;
-};
+        auto &pool = BufferPool::local();
+        auto buf = pool.acquire(datagram.size);
+        std::memcpy(buf.data(), datagram.data, datagram.size);
 
-class ReceiveFrom :
-    public microloop::EventSource,
-    public microloop::TypeHelper<AddressWrapper, microloop::Buffer>
-{
-public:
-  static constexpr std::size_t DEFAULT_MAX_READ_SIZE = 2048;
-
-  ReceiveFrom(std::uint32_t sock,
-      Callback &&callback,
-      std::size_t max_read_size = DEFAULT_MAX_READ_SIZE) :
-      EventSource{sock}, on_recv_{std::move(callback)}, max_read_size_{max_read_size}
-  {}
+        callback(datagram.source, buf);
+        pool.release(std::move(buf));
+      }
+    };
+  }
 
   std::uint32_t produced_events() const override
   {
@@ -84,36 +80,17 @@ public:
 
   void run_callback() override
   {
-    run_recv();
-    std::apply(on_recv_, get_return_object());
-  }
-
-private:
-  void run_recv()
-  {
-    microloop::Buffer buf{max_read_size_};
-    sockaddr_storage addr{};
-    socklen_t addrlen = sizeof(addr);
-
-    ssize_t nrecv = recvfrom(get_fd(), buf.data(), buf.size(), 0, (sockaddr *)&addr, &addrlen);
-    if (nrecv == -1)
+    if (batch_.receive(get_fd(), MSG_DONTWAIT) == 0)
     {
-      if (errno == EAGAIN || errno == EWOULDBLOCK)
-      {
-        return;
-      }
-
-      throw microloop::KernelException(errno);
+      return;
     }
 
-    buf.resize(nrecv);
-
-    set_return_object(std::make_tuple(AddressWrapper{get_fd(), addr, addrlen}, buf));
+    on_recv_(batch_);
   }
 
 private:
-  std::size_t max_read_size_;
-  Callback on_recv_;
+  BatchCallback on_recv_;
+  DatagramBatch batch_;
 };
 
 }  // namespace net_utils
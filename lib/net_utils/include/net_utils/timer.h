@@ -0,0 +1,105 @@
+#pragma once
+
+#include "microloop/event_source.h"
+#include "microloop/kernel_exception.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <utility>
+
+namespace net_utils
+{
+
+/**
+ * \brief Event source backed by a `timerfd`, invoking a callback when the timer expires.
+ */
+class Timer : public microloop::EventSource
+{
+public:
+  using Callback = std::function<void()>;
+
+  Timer(Callback &&callback) : EventSource{create_timerfd()}, on_expire_{std::move(callback)}
+  {}
+
+  /**
+   * \brief Arm the timer to expire after \p delay, then every \p interval if it is not zero.
+   * Arming an armed timer overrides its previous setting. Note that a zero \p delay disarms it.
+   */
+  void arm(std::chrono::microseconds delay,
+      std::chrono::microseconds interval = std::chrono::microseconds::zero())
+  {
+    itimerspec spec{to_timespec(interval), to_timespec(delay)};
+    if (timerfd_settime(get_fd(), 0, &spec, nullptr) == -1)
+    {
+      throw microloop::KernelException{errno};
+    }
+  }
+
+  void disarm()
+  {
+    itimerspec spec{};
+    if (timerfd_settime(get_fd(), 0, &spec, nullptr) == -1)
+    {
+      throw microloop::KernelException{errno};
+    }
+  }
+
+  std::uint32_t produced_events() const override
+  {
+    return EPOLLIN;
+  }
+
+  bool native_async() const override
+  {
+    /* Run the callback on the main thread, along with the state it is meant to act upon. */
+    return true;
+  }
+
+  void start() override
+  {}
+
+  void run_callback() override
+  {
+    std::uint64_t expirations;
+    if (read(get_fd(), &expirations, sizeof(expirations)) == -1)
+    {
+      if (errno == EAGAIN)
+      {
+        return;
+      }
+
+      throw microloop::KernelException{errno};
+    }
+
+    on_expire_();
+  }
+
+private:
+  static std::uint32_t create_timerfd()
+  {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1)
+    {
+      throw microloop::KernelException{errno};
+    }
+
+    return static_cast<std::uint32_t>(fd);
+  }
+
+  static timespec to_timespec(std::chrono::microseconds us)
+  {
+    auto secs = std::chrono::duration_cast<std::chrono::seconds>(us);
+    auto nsecs = std::chrono::duration_cast<std::chrono::nanoseconds>(us - secs);
+
+    return timespec{static_cast<time_t>(secs.count()), static_cast<long>(nsecs.count())};
+  }
+
+private:
+  Callback on_expire_;
+};
+
+}  // namespace net_utils
@@ -2,41 +2,62 @@
 
 #include "microloop/event_loop.h"
 #include "microloop/event_sources/net/receive.h"
+#include "net_utils/datagram_batch.h"
 #include "net_utils/receive_from.h"
 
+#include <cstdint>
+#include <functional>
+
 namespace net_utils
 {
 
 class UdpServer
 {
-  using DataHandler = std::function<void(const AddressWrapper &, const microloop::Buffer &)>;
-
 public:
-  UdpServer(std::uint16_t port);
+  /**
+   * \param batch_size The maximum number of datagrams to be drained from the socket per wakeup.
+   */
+  UdpServer(std::uint16_t port, std::size_t batch_size = ReceiveFrom::DEFAULT_BATCH_SIZE);
 
+  /**
+   * \brief Binds a handler to be invoked for every received datagram.
+   */
   template <class Func, class... Args>
   void set_data_callback(Func &&func, Args &&... args)
   {
     using namespace std::placeholders;
 
     auto bound = std::bind(std::forward<Func>(func), std::forward<Args>(args)..., _1, _2);
-    on_data_ = std::move(bound);
+    on_batch_ = ReceiveFrom::per_datagram(std::move(bound));
+  }
+
+  /**
+   * \brief Binds a handler to be invoked with every batch of datagrams received in one wakeup.
+   */
+  template <class Func, class... Args>
+  void set_batch_callback(Func &&func, Args &&... args)
+  {
+    using namespace std::placeholders;
+
+    auto bound = std::bind(std::forward<Func>(func), std::forward<Args>(args)..., _1);
+    on_batch_ = std::move(bound);
   }
 
-private:
   /**
    * Create a passive socket listening on an unspecified address on either IPv4 or IPv6 on the
    * given port.
    * @param  port The port to listen on.
-   * @return A non-negative file descriptor of the TCP passive socket.
+   * @param  reuse_port Whether to set `SO_REUSEPORT`, so multiple sockets can share the port.
+   * @return A non-negative file descriptor of the UDP passive socket.
    */
-  static std::uint32_t create_passive_socket(std::uint16_t port);
+  static std::uint32_t create_passive_socket(std::uint16_t port, bool reuse_port = false);
 
-  void handle_data(const AddressWrapper &source, const microloop::Buffer &buffer);
+private:
+  void handle_batch(const DatagramBatch &batch);
 
 private:
   std::uint16_t port_;
-  DataHandler on_data_;
+  ReceiveFrom::BatchCallback on_batch_;
 };
 
 }  // namespace net_utils
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "net_utils/datagram_batch.h"
+#include "net_utils/receive_from.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace net_utils
+{
+
+/**
+ * \brief Group of UDP sockets bound to the same port with `SO_REUSEPORT`, each one drained by its
+ * own thread.
+ *
+ * The kernel spreads incoming datagrams across the sockets of the group by hashing the source
+ * address, so all the datagrams of a given device are received by the same shard, in order.
+ *
+ * Note that the batch callback is invoked concurrently from all the shard threads, along with the
+ * index of the calling shard, so per-shard state needs no locking against the other shards.
+ */
+class UdpShards
+{
+public:
+  using BatchCallback = std::function<void(std::size_t, const DatagramBatch &)>;
+
+  UdpShards(std::uint16_t port,
+      std::size_t count,
+      std::size_t batch_size,
+      BatchCallback &&callback);
+
+  UdpShards(const UdpShards &) = delete;
+  UdpShards &operator=(const UdpShards &) = delete;
+
+  /**
+   * \brief Stop all the shard threads and close their sockets.
+   */
+  ~UdpShards();
+
+  std::size_t size() const
+  {
+    return socks_.size();
+  }
+
+private:
+  void run(std::size_t shard, std::size_t batch_size);
+
+private:
+  BatchCallback on_batch_;
+  std::atomic<bool> stopping_{false};
+  std::vector<std::uint32_t> socks_;
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace net_utils
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "microloop/event_source.h"
+#include "microloop/kernel_exception.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <functional>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <utility>
+
+namespace net_utils
+{
+
+/**
+ * \brief Event source telling when sockets become writable again.
+ *
+ * Sockets are watched through an epoll instance of its own, nested into the event loop, so sockets
+ * already watched by the event loop for input can be watched for output as well. Watches are
+ * one-shot: a socket has to be watched again to be told about it again.
+ */
+class WritableWatcher : public microloop::EventSource
+{
+public:
+  using Callback = std::function<void(std::uint32_t fd)>;
+
+  WritableWatcher(Callback &&callback) :
+      EventSource{create_epoll()}, on_writable_{std::move(callback)}
+  {}
+
+  /**
+   * \brief Invoke the callback once \p fd becomes writable.
+   */
+  void watch(std::uint32_t fd)
+  {
+    epoll_event ev{};
+    ev.events = EPOLLOUT | EPOLLONESHOT;
+    ev.data.fd = fd;
+
+    /* Sockets stay registered after their watch fires, so they are usually only re-armed. */
+    if (epoll_ctl(get_fd(), EPOLL_CTL_MOD, fd, &ev) == -1 &&
+        (errno != ENOENT || epoll_ctl(get_fd(), EPOLL_CTL_ADD, fd, &ev) == -1))
+    {
+      throw microloop::KernelException{errno};
+    }
+  }
+
+  /**
+   * \brief Stop watching \p fd. Must be called before the socket is closed.
+   */
+  void unwatch(std::uint32_t fd)
+  {
+    if (epoll_ctl(get_fd(), EPOLL_CTL_DEL, fd, nullptr) == -1 && errno != ENOENT)
+    {
+      throw microloop::KernelException{errno};
+    }
+  }
+
+  std::uint32_t produced_events() const override
+  {
+    return EPOLLIN;
+  }
+
+  bool native_async() const override
+  {
+    /* Run the callback on the main thread, where the outbound queues live. */
+    return true;
+  }
+
+  void start() override
+  {}
+
+  void run_callback() override
+  {
+    static constexpr int MAX_EVENTS = 64;
+
+    epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(get_fd(), events, MAX_EVENTS, 0);
+    if (count == -1)
+    {
+      if (errno == EINTR)
+      {
+        return;
+      }
+
+      throw microloop::KernelException{errno};
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+      on_writable_(events[i].data.fd);
+    }
+  }
+
+private:
+  static std::uint32_t create_epoll()
+  {
+    int fd = epoll_create1(EPOLL_CLOEXEC);
+    if (fd == -1)
+    {
+      throw microloop::KernelException{errno};
+    }
+
+    return static_cast<std::uint32_t>(fd);
+  }
+
+private:
+  Callback on_writable_;
+};
+
+}  // namespace net_utils
@@ -0,0 +1,149 @@
+#include "net_utils/address_wrapper.h"
+
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sstream>
+#include <sys/socket.h>
+
+namespace net_utils
+{
+
+bool AddressWrapper::send(const microloop::Buffer &buf) const
+{
+  std::size_t total_sent = 0;
+
+  while (total_sent != buf.size())
+  {
+    const std::uint8_t *data = static_cast<const std::uint8_t *>(buf.data());
+    ssize_t nsent = ::sendto(
+        server_sock_, data + total_sent, buf.size() - total_sent, 0, (sockaddr *)&addr_, addrlen_);
+    if (nsent == -1)
+    {
+      return false;
+    }
+
+    total_sent += nsent;
+  }
+
+  return true;
+}
+
+std::string AddressWrapper::str() const
+{
+  static constexpr std::size_t port_strlen = 8;
+
+  char hostbuf[INET6_ADDRSTRLEN]{};
+  char portbuf[port_strlen]{};
+
+  auto err_code = getnameinfo(reinterpret_cast<const sockaddr *>(&addr_), addrlen_, hostbuf,
+      sizeof(hostbuf), portbuf, sizeof(portbuf), NI_NUMERICHOST | NI_NUMERICSERV);
+  if (err_code != 0)
+  {
+    std::stringstream err;
+    err << __PRETTY_FUNCTION__ << ": " << gai_strerror(err_code);
+
+    throw std::runtime_error(err.str());
+  }
+
+  char buf[sizeof(hostbuf) + sizeof(portbuf) + 1]{};
+  /* No buffer overflow can occur here, due to both buffer being checked prior this call. */
+  sprintf(buf, "%s:%s", hostbuf, portbuf);
+
+  return buf;
+}
+
+void AddressWrapper::to_binary(std::uint8_t *dest) const
+{
+  std::memset(dest, 0, bin_size);
+
+  if (addr_.ss_family == AF_INET)
+  {
+    auto in = reinterpret_cast<const sockaddr_in *>(&addr_);
+
+    dest[10] = 0xff;
+    dest[11] = 0xff;
+    std::memcpy(dest + 12, &in->sin_addr, sizeof(in->sin_addr));
+    std::memcpy(dest + 16, &in->sin_port, sizeof(in->sin_port));
+  }
+  else if (addr_.ss_family == AF_INET6)
+  {
+    auto in6 = reinterpret_cast<const sockaddr_in6 *>(&addr_);
+
+    std::memcpy(dest, &in6->sin6_addr, sizeof(in6->sin6_addr));
+    std::memcpy(dest + 16, &in6->sin6_port, sizeof(in6->sin6_port));
+  }
+}
+
+AddressWrapper AddressWrapper::from_binary(const std::uint8_t *bin)
+{
+  static constexpr std::uint8_t v4_mapped_prefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+
+  sockaddr_storage addr{};
+  socklen_t addrlen;
+
+  if (std::memcmp(bin, v4_mapped_prefix, sizeof(v4_mapped_prefix)) == 0)
+  {
+    auto in = reinterpret_cast<sockaddr_in *>(&addr);
+
+    in->sin_family = AF_INET;
+    std::memcpy(&in->sin_addr, bin + 12, sizeof(in->sin_addr));
+    std::memcpy(&in->sin_port, bin + 16, sizeof(in->sin_port));
+    addrlen = sizeof(sockaddr_in);
+  }
+  else
+  {
+    auto in6 = reinterpret_cast<sockaddr_in6 *>(&addr);
+
+    in6->sin6_family = AF_INET6;
+    std::memcpy(&in6->sin6_addr, bin, sizeof(in6->sin6_addr));
+    std::memcpy(&in6->sin6_port, bin + 16, sizeof(in6->sin6_port));
+    addrlen = sizeof(sockaddr_in6);
+  }
+
+  return AddressWrapper{0, addr, addrlen};
+}
+
+bool AddressWrapper::str_to_binary(std::string_view str, std::uint8_t *dest)
+{
+  auto colon = str.rfind(':');
+  if (colon == std::string_view::npos || colon + 1 == str.size() || colon >= INET6_ADDRSTRLEN)
+  {
+    return false;
+  }
+
+  char host[INET6_ADDRSTRLEN]{};
+  std::memcpy(host, str.data(), colon);
+
+  unsigned long port = 0;
+  for (auto c : str.substr(colon + 1))
+  {
+    if (c < '0' || c > '9' || (port = port * 10 + (c - '0')) > 0xffff)
+    {
+      return false;
+    }
+  }
+
+  std::memset(dest, 0, bin_size);
+
+  in_addr in;
+  if (inet_pton(AF_INET, host, &in) == 1)
+  {
+    dest[10] = 0xff;
+    dest[11] = 0xff;
+    std::memcpy(dest + 12, &in, sizeof(in));
+  }
+  else if (inet_pton(AF_INET6, host, dest) != 1)
+  {
+    return false;
+  }
+
+  std::uint16_t net_port = htons(port);
+  std::memcpy(dest + 16, &net_port, sizeof(net_port));
+
+  return true;
+}
+
+}  // namespace net_utils
@@ -0,0 +1,112 @@
+#include "net_utils/buffer_pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <utility>
+
+namespace net_utils
+{
+
+namespace
+{
+
+/* Registry of the pools of all live threads, only used to aggregate statistics. */
+std::mutex registry_mutex;
+std::vector<const BufferPool *> registry;
+
+}  // namespace
+
+BufferPool &BufferPool::local()
+{
+  thread_local BufferPool pool;
+  return pool;
+}
+
+BufferPool::Stats BufferPool::total_stats()
+{
+  std::lock_guard<std::mutex> lock{registry_mutex};
+
+  Stats total;
+  for (auto pool : registry)
+  {
+    auto s = pool->stats();
+
+    total.hits += s.hits;
+    total.misses += s.misses;
+    total.overflows += s.overflows;
+    total.cached += s.cached;
+    total.high_water += s.high_water;
+  }
+
+  return total;
+}
+
+BufferPool::BufferPool() : free_lists_(MAX_POOLED_SIZE + 1)
+{
+  std::lock_guard<std::mutex> lock{registry_mutex};
+  registry.push_back(this);
+}
+
+BufferPool::~BufferPool()
+{
+  std::lock_guard<std::mutex> lock{registry_mutex};
+  registry.erase(std::remove(registry.begin(), registry.end(), this), registry.end());
+}
+
+microloop::Buffer BufferPool::acquire(std::size_t size)
+{
+  if (size == 0 || size > MAX_POOLED_SIZE || free_lists_[size].empty())
+  {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return microloop::Buffer{size};
+  }
+
+  auto &free_list = free_lists_[size];
+  microloop::Buffer buf = std::move(free_list.back());
+  free_list.pop_back();
+
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  cached_.fetch_sub(1, std::memory_order_relaxed);
+
+  std::memset(buf.data(), 0, buf.size());
+  return buf;
+}
+
+void BufferPool::release(microloop::Buffer &&buf)
+{
+  auto size = buf.size();
+  if (size == 0 || size > MAX_POOLED_SIZE)
+  {
+    return;
+  }
+
+  auto &free_list = free_lists_[size];
+  if (free_list.size() == MAX_FREE_PER_CLASS)
+  {
+    overflows_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  free_list.push_back(std::move(buf));
+
+  auto cached = cached_.fetch_add(1, std::memory_order_relaxed) + 1;
+  if (cached > high_water_.load(std::memory_order_relaxed))
+  {
+    high_water_.store(cached, std::memory_order_relaxed);
+  }
+}
+
+BufferPool::Stats BufferPool::stats() const
+{
+  Stats s;
+  s.hits = hits_.load(std::memory_order_relaxed);
+  s.misses = misses_.load(std::memory_order_relaxed);
+  s.overflows = overflows_.load(std::memory_order_relaxed);
+  s.cached = cached_.load(std::memory_order_relaxed);
+  s.high_water = high_water_.load(std::memory_order_relaxed);
+
+  return s;
+}
+
+}  // namespace net_utils
@@ -0,0 +1,55 @@
+#include "net_utils/datagram_batch.h"
+
+#include "microloop/kernel_exception.h"
+
+#include <cerrno>
+#include <sys/socket.h>
+
+namespace net_utils
+{
+
+DatagramBatch::DatagramBatch(std::size_t capacity, std::size_t max_datagram_size) :
+    max_datagram_size_{max_datagram_size},
+    slab_(capacity * max_datagram_size),
+    addrs_(capacity),
+    iovecs_(capacity),
+    headers_(capacity)
+{
+  for (std::size_t i = 0; i < capacity; i++)
+  {
+    iovecs_[i].iov_base = slab_.data() + i * max_datagram_size_;
+    iovecs_[i].iov_len = max_datagram_size_;
+
+    headers_[i].msg_hdr.msg_iov = &iovecs_[i];
+    headers_[i].msg_hdr.msg_iovlen = 1;
+    headers_[i].msg_hdr.msg_name = &addrs_[i];
+  }
+}
+
+std::size_t DatagramBatch::receive(std::uint32_t sock, int flags)
+{
+  sock_ = sock;
+  size_ = 0;
+
+  /* The kernel overwrites the address lengths, so they must be reset before every call. */
+  for (auto &hdr : headers_)
+  {
+    hdr.msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+  }
+
+  int nrecv = recvmmsg(sock, headers_.data(), headers_.size(), flags, nullptr);
+  if (nrecv == -1)
+  {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+    {
+      return 0;
+    }
+
+    throw microloop::KernelException(errno);
+  }
+
+  size_ = static_cast<std::size_t>(nrecv);
+  return size_;
+}
+
+}  // namespace net_utils
@@ -15,15 +15,16 @@
 namespace net_utils
 {
 
-UdpServer::UdpServer(std::uint16_t port) : port_{port}
+UdpServer::UdpServer(std::uint16_t port, std::size_t batch_size) : port_{port}
 {
   using namespace std::placeholders;
   using microloop::EventLoop;
 
   auto server_fd = create_passive_socket(port);
 
-  auto data_handler = std::bind(&UdpServer::handle_data, this, _1, _2);
-  EventLoop::instance().add_event_source(new ReceiveFrom(server_fd, data_handler));
+  ReceiveFrom::BatchCallback batch_handler = std::bind(&UdpServer::handle_batch, this, _1);
+  EventLoop::instance().add_event_source(
+      new ReceiveFrom(server_fd, std::move(batch_handler), batch_size));
 
   EventLoop::instance().register_signal_handler(SIGINT, [](std::uint32_t) {
     /*
@@ -34,7 +35,7 @@ UdpServer::UdpServer(std::uint16_t port) : port_{port}
   });
 }
 
-std::uint32_t UdpServer::create_passive_socket(std::uint16_t port)
+std::uint32_t UdpServer::create_passive_socket(std::uint16_t port, bool reuse_port)
 {
   auto port_str = std::to_string(port);
 
@@ -64,6 +65,12 @@ std::uint32_t UdpServer::create_passive_socket(std::uint16_t port)
       continue;
     }
 
+    if (int f = 1; reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &f, sizeof(f)) == -1)
+    {
+      close(fd);
+      continue;
+    }
+
     if (bind(fd, r->ai_addr, r->ai_addrlen) == 0)
     {
       /*
@@ -89,9 +96,9 @@ std::uint32_t UdpServer::create_passive_socket(std::uint16_t port)
   return static_cast<std::uint32_t>(fd);
 }
 
-void UdpServer::handle_data(const AddressWrapper &source, const microloop::Buffer &buf)
+void UdpServer::handle_batch(const DatagramBatch &batch)
 {
-  on_data_(source, buf);
+  on_batch_(batch);
 }
 
 }  // namespace net_utils
@@ -0,0 +1,73 @@
+#include "net_utils/udp_shards.h"
+
+#include "net_utils/udp_server.h"
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace net_utils
+{
+
+UdpShards::UdpShards(std::uint16_t port,
+    std::size_t count,
+    std::size_t batch_size,
+    BatchCallback &&callback) :
+    on_batch_{std::move(callback)}
+{
+  for (std::size_t i = 0; i < count; i++)
+  {
+    socks_.push_back(UdpServer::create_passive_socket(port, true));
+  }
+
+  for (std::size_t shard = 0; shard < count; shard++)
+  {
+    threads_.emplace_back(&UdpShards::run, this, shard, batch_size);
+  }
+}
+
+UdpShards::~UdpShards()
+{
+  stopping_ = true;
+
+  /* Shutting a socket down wakes up the thread blocked on receiving from it. */
+  for (auto sock : socks_)
+  {
+    shutdown(sock, SHUT_RDWR);
+  }
+
+  for (auto &t : threads_)
+  {
+    t.join();
+  }
+
+  for (auto sock : socks_)
+  {
+    close(sock);
+  }
+}
+
+void UdpShards::run(std::size_t shard, std::size_t batch_size)
+{
+  auto sock = socks_[shard];
+
+  /* Signals are handled by the event loop thread. */
+  sigset_t all;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, nullptr);
+
+  DatagramBatch batch{batch_size, ReceiveFrom::DEFAULT_MAX_READ_SIZE};
+
+  while (!stopping_)
+  {
+    /* Block until at least one datagram arrives, then take whatever else is already queued. */
+    if (batch.receive(sock, MSG_WAITFORONE) == 0)
+    {
+      continue;
+    }
+
+    on_batch_(shard, batch);
+  }
+}
+
+}  // namespace net_utils
@@ -1,17 +1,24 @@
 #pragma once
 
 #include "absl/strings/str_split.h"
+#include "commons/frame_decoder.h"
 #include "commons/subscriber_messages.h"
 #include "net_utils/keyboard_input.h"
 #include "net_utils/tcp_client.h"
 
+#include <algorithm>
 #include <cstdint>
+#include <cstdlib>
 #include <iostream>
+#include <iterator>
+#include <queue>
 #include <signal.h>
+#include <stdexcept>
 #include <string>
 #include <type_traits>
 #include <unistd.h>
 #include <variant>
+#include <vector>
 
 namespace subscriber
 {
@@ -19,8 +26,14 @@ namespace subscriber
 class Subscriber
 {
 public:
-  Subscriber(std::string client_id, std::string server_ip, std::uint16_t server_port) :
-      client_id_{client_id}, client_{server_ip, server_port}
+  /**
+   * \param protocol The latest protocol version to be requested from the Gateway.
+   */
+  Subscriber(std::string client_id,
+      std::string server_ip,
+      std::uint16_t server_port,
+      std::uint8_t protocol = commons::subscriber_messages::PROTOCOL_LATEST) :
+      client_id_{client_id}, protocol_{protocol}, client_{server_ip, server_port}
   {
     using microloop::EventLoop;
 
@@ -51,7 +64,7 @@ private:
 
     std::cout << "Connected to " << c.str() << "\n";
 
-    commons::subscriber_messages::GreetingMessage greeting{client_id_};
+    commons::subscriber_messages::GreetingMessage greeting{client_id_, protocol_};
     c.send(greeting.serialize());
   }
 
@@ -72,12 +85,16 @@ private:
 
     using namespace commons::subscriber_messages;
 
-    fragment_ += buf;
-
-    while (can_parse_entire_msg(fragment_))
-    {
-      auto [message, consumed] = from_buffer(fragment_);
-      fragment_.remove_prefix(consumed);
+    auto on_frame = [this](const std::uint8_t *frame, std::size_t size) {
+      SubscriberMessage message;
+      try
+      {
+        message = from_buffer(frame, size, decoder_.version(), &topics_).first;
+      }
+      catch (const std::runtime_error &)
+      {
+        return false;
+      }
 
       std::visit(
           [&](auto &&msg) {
@@ -87,7 +104,19 @@ private:
             {
               using namespace commons::server_response;
 
-              if (msg.code == StatusCode::OK) {}
+              static constexpr std::string_view snapshot = "snapshot=";
+
+              std::string_view notes = msg.notes;
+
+              if (msg.code == StatusCode::OK && notes.rfind(snapshot, 0) == 0)
+              {
+                auto count = notes.substr(snapshot.size());
+                std::cout << "response: snapshot of " << count << " topics\n";
+              }
+              else if (msg.code == StatusCode::OK)
+              {
+                on_protocol_ack(notes);
+              }
               else if (msg.code == StatusCode::SUBSCRIBE_SUCCESSFUL)
               {
                 auto topic = msg.notes;
@@ -103,6 +132,14 @@ private:
                 std::cerr << "error response: " << status_str(msg.code) << "\n";
               }
             }
+            else if constexpr (std::is_same_v<T, BulkResponse>)
+            {
+              on_bulk_response(msg);
+            }
+            else if constexpr (std::is_same_v<T, TopicDefinition>)
+            {
+              topics_[msg.id] = std::move(msg.topic);
+            }
             else if constexpr (std::is_same_v<T, DeviceNotification>)
             {
               std::cout << msg.device_address << " - ";
@@ -111,6 +148,14 @@ private:
             }
           },
           message);
+
+      return true;
+    };
+
+    if (!decoder_.feed(buf.data(), buf.size(), on_frame))
+    {
+      std::cerr << "error: malformed message from the server\n";
+      kill(getpid(), SIGINT);
     }
   }
 
@@ -131,8 +176,8 @@ private:
 
     if (command == "subscribe")
     {
-      static constexpr std::string_view usage = "subscribe topic store_forward";
-      if (parts.size() != 3)
+      static constexpr std::string_view usage = "subscribe topic store_forward [conflate]";
+      if (parts.size() != 3 && parts.size() != 4)
       {
         std::cerr << "usage: " << usage << "\n";
         return;
@@ -140,22 +185,22 @@ private:
 
       auto topic = parts[1];
       bool store_forward;
+      bool conflate = false;
 
-      if (parts[2] == "true" || parts[2] == "TRUE" || parts[2] == "1")
-      {
-        store_forward = true;
-      }
-      else if (parts[2] == "false" || parts[2] == "FALSE" || parts[2] == "0")
+      if (!parse_flag(parts[2], store_forward))
       {
-        store_forward = false;
+        std::cerr << "error: invalid value for store_forward\n";
+        return;
       }
-      else
+
+      if (parts.size() == 4 && !parse_flag(parts[3], conflate))
       {
-        std::cerr << "error: invalid value for store_forward\n";
+        std::cerr << "error: invalid value for conflate\n";
         return;
       }
 
       commons::subscriber_messages::SubscribeRequest request{std::string{topic}, store_forward};
+      request.conflate = conflate;
       conn_->send(request.serialize());
     }
     else if (command == "unsubscribe")
@@ -172,17 +217,170 @@ private:
       commons::subscriber_messages::UnsubscribeRequest request{std::string{topic}};
       conn_->send(request.serialize());
     }
+    else if (command == "bulk_subscribe")
+    {
+      static constexpr std::string_view usage = "bulk_subscribe topic:store_forward...";
+      if (parts.size() < 2)
+      {
+        std::cerr << "usage: " << usage << "\n";
+        return;
+      }
+
+      std::vector<commons::subscriber_messages::SubscribeRequest> subscriptions;
+      for (auto it = parts.begin() + 1; it != parts.end(); ++it)
+      {
+        auto sep = it->rfind(':');
+        bool store_forward;
+
+        if (sep == std::string_view::npos || !parse_flag(it->substr(sep + 1), store_forward))
+        {
+          std::cerr << "usage: " << usage << "\n";
+          return;
+        }
+
+        subscriptions.push_back({std::string{it->substr(0, sep)}, store_forward});
+      }
+
+      send_bulk(subscriptions, [](auto first, auto last) {
+        return commons::subscriber_messages::BulkSubscribeRequest{{first, last}}.serialize();
+      });
+    }
+    else if (command == "snapshot")
+    {
+      conn_->send(commons::subscriber_messages::SnapshotRequest{}.serialize());
+    }
+    else if (command == "bulk_unsubscribe")
+    {
+      static constexpr std::string_view usage = "bulk_unsubscribe topic...";
+      if (parts.size() < 2)
+      {
+        std::cerr << "usage: " << usage << "\n";
+        return;
+      }
+
+      std::vector<commons::subscriber_messages::Topic> topics{parts.begin() + 1, parts.end()};
+
+      send_bulk(topics, [](auto first, auto last) {
+        return commons::subscriber_messages::BulkUnsubscribeRequest{{first, last}}.serialize();
+      });
+    }
     else
     {
       std::cerr << "unknown command: " << command << "\n";
     }
   }
 
+  /**
+   * \brief Switch to the protocol version acknowledged by the Gateway. The messages following the
+   * acknowledgement are encoded using that version.
+   */
+  void on_protocol_ack(std::string_view notes)
+  {
+    static constexpr std::string_view prefix = "protocol=";
+    if (notes.substr(0, prefix.size()) != prefix)
+    {
+      return;
+    }
+
+    int version = std::atoi(std::string{notes.substr(prefix.size())}.c_str());
+    if (version > 0 && version <= protocol_)
+    {
+      decoder_.set_version(version);
+    }
+  }
+
+  static bool parse_flag(std::string_view value, bool &flag)
+  {
+    if (value == "true" || value == "TRUE" || value == "1")
+    {
+      flag = true;
+    }
+    else if (value == "false" || value == "FALSE" || value == "0")
+    {
+      flag = false;
+    }
+    else
+    {
+      return false;
+    }
+
+    return true;
+  }
+
+  static const commons::subscriber_messages::Topic &topic_of(
+      const commons::subscriber_messages::SubscribeRequest &req)
+  {
+    return req.topic;
+  }
+
+  static const commons::subscriber_messages::Topic &topic_of(
+      const commons::subscriber_messages::Topic &topic)
+  {
+    return topic;
+  }
+
+  /**
+   * \brief Send the entries of a bulk request, split into as many messages as needed. The topics
+   * are remembered, so that the bitmaps of the responses can be reported.
+   */
+  template <class Entry, class Serialize>
+  void send_bulk(const std::vector<Entry> &entries, Serialize &&serialize)
+  {
+    using commons::subscriber_messages::BULK_MAX_TOPICS;
+
+    for (std::size_t i = 0; i < entries.size(); i += BULK_MAX_TOPICS)
+    {
+      auto first = entries.begin() + i;
+      auto last = entries.begin() + std::min(entries.size(), i + BULK_MAX_TOPICS);
+
+      auto &topics = bulk_topics_.emplace();
+      std::transform(first, last, std::back_inserter(topics),
+          [](auto &&entry) { return topic_of(entry); });
+
+      conn_->send(serialize(first, last));
+    }
+  }
+
+  void on_bulk_response(const commons::subscriber_messages::BulkResponse &response)
+  {
+    using namespace commons::subscriber_messages;
+
+    if (bulk_topics_.empty())
+    {
+      return;
+    }
+
+    auto topics = std::move(bulk_topics_.front());
+    bulk_topics_.pop();
+
+    auto subscribe = response.request == MessageType::BULK_SUBSCRIBE;
+    auto succeeded = std::count(response.results.begin(), response.results.end(), true);
+
+    std::cout << "response: " << (subscribe ? "subscribed to " : "unsubscribed from ") << succeeded
+              << " of " << topics.size() << " topics\n";
+
+    for (std::size_t i = 0; i < std::min(topics.size(), response.results.size()); i++)
+    {
+      if (!response.results[i])
+      {
+        std::cerr << "error response: " << topics[i] << ": "
+                  << (subscribe ? "Already subscribed." : "Subscription not found.") << "\n";
+      }
+    }
+  }
+
 private:
   std::string client_id_;
+  std::uint8_t protocol_;
   net_utils::TcpClient client_;
   net_utils::AddressWrapper *conn_;  // Not managed by this class.
-  microloop::Buffer fragment_;  // Fragment of message to be parsed on next read iteration.
+  commons::subscriber_messages::FrameDecoder decoder_;
+
+  /* Topics defined by the Gateway on this connection, when using protocol version 3. */
+  commons::subscriber_messages::TopicTable topics_;
+
+  /* Topics of the bulk requests waiting for a response, in the order they were sent. */
+  std::queue<std::vector<commons::subscriber_messages::Topic>> bulk_topics_;
 };
 
 }  // namespace subscriber
@@ -2,14 +2,140 @@
 #include "microloop/event_loop.h"
 #include "net_utils/keyboard_input.h"
 
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <signal.h>
+#include <string>
+#include <string_view>
+
+/**
+ * \brief Parse the name of an overflow policy into \p policy.
+ * \returns Whether the name is valid.
+ */
+static bool parse_overflow(std::string_view name, gateway::OverflowPolicy &policy)
+{
+  using gateway::OverflowPolicy;
+
+  if (name == "drop-oldest")
+  {
+    policy = OverflowPolicy::DROP_OLDEST;
+  }
+  else if (name == "conflate")
+  {
+    policy = OverflowPolicy::CONFLATE;
+  }
+  else if (name == "spill")
+  {
+    policy = OverflowPolicy::SPILL;
+  }
+  else if (name == "disconnect")
+  {
+    policy = OverflowPolicy::DISCONNECT;
+  }
+  else
+  {
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * \brief Parse \p str as a decimal number, without any leftover characters.
+ * \returns The number, or -1 if \p str is not a number, which every numeric option rejects.
+ */
+static long parse_number(std::string_view str)
+{
+  long value;
+  auto end = str.data() + str.size();
+  auto [ptr, ec] = std::from_chars(str.data(), end, value);
+
+  return ec == std::errc{} && ptr == end ? value : -1;
+}
+
+/**
+ * \brief Parse an optional argument given as "--name=value" into \p config.
+ * \returns Whether the argument is a known option with a valid value.
+ */
+static bool parse_option(std::string_view arg, gateway::Config &config)
+{
+  auto eq = arg.find('=');
+  if (arg.substr(0, 2) != "--" || eq == std::string_view::npos)
+  {
+    return false;
+  }
+
+  auto name = arg.substr(2, eq - 2);
+  auto value_str = arg.substr(eq + 1);
+  auto value = parse_number(value_str);
+
+  if (name == "udp-batch" && value > 0)
+  {
+    config.udp_batch_size = value;
+  }
+  else if (name == "udp-shards" && value >= 0)
+  {
+    config.udp_shards = value;
+  }
+  else if (name == "udp-handoff" && value > 0)
+  {
+    config.udp_handoff = value;
+  }
+  else if (name == "tcp-reactors" && value >= 0)
+  {
+    config.tcp_reactors = value;
+  }
+  else if (name == "coalesce-bytes" && value >= 0)
+  {
+    config.coalesce_bytes = value;
+  }
+  else if (name == "coalesce-us" && value >= 0)
+  {
+    config.coalesce_us = value;
+  }
+  else if (name == "queue-high" && value > 0)
+  {
+    config.queue_high = value;
+  }
+  else if (name == "queue-low" && value >= 0)
+  {
+    config.queue_low = value;
+  }
+  else if (name == "overflow")
+  {
+    return parse_overflow(value_str, config.overflow);
+  }
+  else if (name == "last-value-bytes" && value >= 0)
+  {
+    config.last_value_bytes = value;
+  }
+  else if (name == "device-sources" && value > 0)
+  {
+    config.device_sources = value;
+  }
+  else if (name == "sf-dir" && !value_str.empty())
+  {
+    config.sf_dir = std::string{value_str};
+  }
+  else if (name == "sf-commit-ms" && value > 0)
+  {
+    config.sf_commit_ms = value;
+  }
+  else
+  {
+    return false;
+  }
+
+  return true;
+}
 
 int main(int argc, char **argv)
 {
   if (argc < 2)
   {
-    std::cerr << "usage: " << argv[0] << " port\n";
+    std::cerr << "usage: " << argv[0] << " port [--option=value...]\n";
     return -1;
   }
 
@@ -20,20 +146,40 @@ int main(int argc, char **argv)
     return -1;
   }
 
+  gateway::Config config;
+  for (int i = 2; i < argc; i++)
+  {
+    if (!parse_option(argv[i], config))
+    {
+      std::cerr << "error: invalid option " << argv[i] << "\n";
+      return -1;
+    }
+  }
+
   signal(SIGWINCH, SIG_IGN);
 
-  gateway::Gateway gateway{port};
+  gateway::Gateway gateway{port, config};
 
   auto keyboard_input = new net_utils::KeyboardInput;
-  keyboard_input->on_input([](const std::string &data) {
+  keyboard_input->on_input([&gateway](const std::string &data) {
     if (data == "exit")
     {
       kill(getpid(), SIGINT);
     }
+    else if (data == "stats")
+    {
+      gateway.print_stats(std::cout);
+    }
+    else if (data == "sources")
+    {
+      gateway.print_sources(std::cout);
+    }
   });
 
   microloop::EventLoop::instance().add_event_source(keyboard_input);
 
   while (MICROLOOP_TICK())
-  {}
+  {
+    gateway.on_tick_end();
+  }
 }
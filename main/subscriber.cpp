@@ -9,7 +9,7 @@ int main(int argc, char **argv)
 {
   if (argc < 4)
   {
-    std::cerr << "usage: " << argv[0] << " client_id server_ip server_port\n";
+    std::cerr << "usage: " << argv[0] << " client_id server_ip server_port [--protocol=N]\n";
     return -1;
   }
 
@@ -29,7 +29,14 @@ int main(int argc, char **argv)
 
   std::uint16_t port = atoi(argv[3]);
 
-  subscriber::Subscriber sub{argv[1], argv[2], port};
+  /* Older protocol versions can be requested, e.g. to talk to an older Gateway. */
+  auto protocol = commons::subscriber_messages::PROTOCOL_LATEST;
+  if (argc > 4 && strncmp(argv[4], "--protocol=", 11) == 0)
+  {
+    protocol = atoi(argv[4] + 11);
+  }
+
+  subscriber::Subscriber sub{argv[1], argv[2], port, protocol};
 
   while (MICROLOOP_TICK())
   {}